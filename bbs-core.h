@@ -0,0 +1,1145 @@
+// ---------------------------------------------------------------------------
+//      Size-specialised part of the generator. bbs.c includes this file
+//      once per supported modulus size, with N_BITS defined, so that every
+//      size gets _BitInt arithmetic of its own width. All names defined
+//      here get an _N_BITS suffix; each instantiation exports its entry
+//      points as a `bbs_ops_t' named ops_N_BITS.
+// ---------------------------------------------------------------------------
+#define SZ(name) SZ_(name, N_BITS)
+#define SZ_(name, n) SZ__(name, n)
+#define SZ__(name, n) name##_##n
+#define bbsint                 SZ(bbsint)
+#define bbs2int                SZ(bbs2int)
+#define barrett_cache          SZ(barrett_cache)
+#define populate_barrett_cache SZ(populate_barrett_cache)
+#define release_barrett_cache  SZ(release_barrett_cache)
+#define p_low                  SZ(p_low)
+#define ilog2                  SZ(ilog2)
+#define csrand                 SZ(csrand)
+#define cand_t                 SZ(cand_t)
+#define cand_init              SZ(cand_init)
+#define pow2mod                SZ(pow2mod)
+#define p_high                 SZ(p_high)
+#define p_low_gcd              SZ(p_low_gcd)
+#define p_test                 SZ(p_test)
+#define trial_bench            SZ(trial_bench)
+#define prime_job_t            SZ(prime_job_t)
+#define prime_search           SZ(prime_search)
+#define generate_primes        SZ(generate_primes)
+#define gcd                    SZ(gcd)
+#define invmod                 SZ(invmod)
+#define barrett_t              SZ(barrett_t)
+#define barrett_init           SZ(barrett_init)
+#define barrett_reduce         SZ(barrett_reduce)
+#define mulmod                 SZ(mulmod)
+#define bbs_ctx_t              SZ(bbs_ctx_t)
+#define bbs_ctx_load           SZ(bbs_ctx_load)
+#define bbs_ctx_new            SZ(bbs_ctx_new)
+#define bbs_ctx_free           SZ(bbs_ctx_free)
+#define bbs_t                  SZ(bbs_t)
+#define bbs_load               SZ(bbs_load)
+#define bbs_seed               SZ(bbs_seed)
+#define bbs_spawn              SZ(bbs_spawn)
+#define bbs_new                SZ(bbs_new)
+#define bbs_step               SZ(bbs_step)
+#define bbs_advance            SZ(bbs_advance)
+#define modexp                 SZ(modexp)
+#define bbs_set                SZ(bbs_set)
+#define bbs_next               SZ(bbs_next)
+#define bbs_next64             SZ(bbs_next64)
+#define bbs_fill               SZ(bbs_fill)
+#define part_job_t             SZ(part_job_t)
+#define bbs_part               SZ(bbs_part)
+#define bbs_split              SZ(bbs_split)
+#define bbs_nextbytes          SZ(bbs_nextbytes)
+#define bbs_jump_t             SZ(bbs_jump_t)
+#define bbs_jump_init          SZ(bbs_jump_init)
+#define bbs_jump_free          SZ(bbs_jump_free)
+#define jump_pow               SZ(jump_pow)
+#define bbs_substream          SZ(bbs_substream)
+#define seek_ent_t             SZ(seek_ent_t)
+#define seek_cmp               SZ(seek_cmp)
+#define seek_job_t             SZ(seek_job_t)
+#define seek_part              SZ(seek_part)
+#define bbs_seek_many          SZ(bbs_seek_many)
+#define bbs_lanes_t            SZ(bbs_lanes_t)
+#define lanes_init             SZ(lanes_init)
+#define lanes_set              SZ(lanes_set)
+#define lanes_mont             SZ(lanes_mont)
+#define lanes_sqr              SZ(lanes_sqr)
+#define lanes_bits             SZ(lanes_bits)
+#define lanes_nextbytes        SZ(lanes_nextbytes)
+#define bbs_nextbytes_lanes    SZ(bbs_nextbytes_lanes)
+#define rns_init               SZ(rns_init)
+#define rns_exact              SZ(rns_exact)
+#define rns_fill               SZ(rns_fill)
+#define bbs_nextbytes_rns      SZ(bbs_nextbytes_rns)
+#define bbs_key_t              SZ(bbs_key_t)
+#define bbs_rekey_t            SZ(bbs_rekey_t)
+#define rekey_job              SZ(rekey_job)
+#define bbs_rekey_start        SZ(bbs_rekey_start)
+#define bbs_rekey_swap         SZ(bbs_rekey_swap)
+#define parse_hex              SZ(parse_hex)
+#define print_hex              SZ(print_hex)
+#define load_seed              SZ(load_seed)
+#define load_fixed             SZ(load_fixed)
+#define run_kat                SZ(run_kat)
+#define op_new                 SZ(op_new)
+#define op_load                SZ(op_load)
+#define op_save                SZ(op_save)
+#define op_spawn               SZ(op_spawn)
+#define op_release             SZ(op_release)
+#define rekeyer                SZ(rekeyer)
+#define op_rekey               SZ(op_rekey)
+#define op_swap                SZ(op_swap)
+#define op_set                 SZ(op_set)
+#define op_tell                SZ(op_tell)
+#define op_substream           SZ(op_substream)
+#define op_nextbytes           SZ(op_nextbytes)
+#define op_nextbytes_lanes     SZ(op_nextbytes_lanes)
+#define op_nextbytes_rns       SZ(op_nextbytes_rns)
+#define ops                    SZ(ops)
+
+typedef unsigned _BitInt(N_BITS) bbsint;
+typedef unsigned _BitInt(N_BITS * 2) bbs2int;
+
+#if N_BITS % 64
+  #error "N_BITS must be a multiple of 64."
+#endif
+#define N_LIMBS (N_BITS / 64)
+
+// ---------------------------------------------------------------------------
+//      Barrett reduction (HAC 14.42) modulo a fixed `m' of k limbs, with
+//      mu = floor(b^2k / m) precomputed. Any x < m^2 is reduced with two
+//      (k + 1)-limb products and at most two subtractions. Products go
+//      through mul_n, so large moduli get Toom-3. The
+//      primality tests use it as well, modulo each candidate. Temporaries
+//      come from the scratch arena `sc' of the calling thread.
+// ---------------------------------------------------------------------------
+typedef struct { int k; limb_t m[N_LIMBS + 1], mu[N_LIMBS + 1]; } barrett_t;
+static void barrett_init(barrett_t * red, bbsint m) {
+  union { bbsint v; limb_t l[N_LIMBS]; } ml = { m };
+  union { bbs2int v; limb_t l[2 * N_LIMBS]; } mu;
+  int k = N_LIMBS;
+  while (k > 1 && !ml.l[k - 1]) k--;
+  // m is odd, so (b^2k - 1) / m = b^2k / m when b^2k overflows bbs2int.
+  mu.v = k == N_LIMBS ? ((bbs2int) -1) / m : ((bbs2int) 1 << 128 * k) / m;
+  red->k = k;
+  memset(red->m, 0, sizeof(red->m));
+  memcpy(red->m, ml.l, k * sizeof(limb_t));
+  memcpy(red->mu, mu.l, (k + 1) * sizeof(limb_t));
+}
+// r[0..k) = x mod m for x[0..2k) < m^2.
+static void barrett_reduce(limb_t * r, const limb_t * x,
+                           const barrett_t * red, scratch_t * sc) {
+  int k = red->k;  size_t mark = sc->used;
+  limb_t * q = scratch_push(sc, (5 * k + 5) * sizeof(limb_t));
+  limb_t * t = q + 2 * k + 2, * u = t + 2 * k + 2;
+  mul_n(q, x + k - 1, red->mu, k + 1, sc);
+  mul_n(t, q + k + 1, red->m, k + 1, sc);
+  sub_n(u, x, t, k + 1);
+  for (int i = 0; i < 2 && !sub_n(t, u, red->m, k + 1); i++)
+    memcpy(u, t, (k + 1) * sizeof(limb_t));
+  memcpy(r, u, k * sizeof(limb_t));
+  sc->used = mark;
+}
+// r = a * b mod m; r may alias a or b.
+static void mulmod(limb_t * r, const limb_t * a, const limb_t * b,
+                   const barrett_t * red, scratch_t * sc) {
+  size_t mark = sc->used;
+  limb_t * t = scratch_push(sc, 2 * red->k * sizeof(limb_t));
+  mul_n(t, a, b, red->k, sc);
+  barrett_reduce(r, t, red, sc);
+  sc->used = mark;
+}
+
+// base^e mod m, for base < m.
+static bbsint modexp(bbsint base, bbsint e, const barrett_t * red,
+                     scratch_t * sc) {
+  size_t mark = sc->used;
+  limb_t * r = scratch_push(sc, 2 * sizeof(bbsint)), * b = r + N_LIMBS;
+  memset(r, 0, sizeof(bbsint));  r[0] = 1;
+  memcpy(b, &base, sizeof(bbsint));
+  while (e) {
+    if (e & 1) {
+      mulmod(r, r, b, red, sc);  PERF_SQUARING();
+    }
+    mulmod(b, b, b, red, sc);
+    e >>= 1;  PERF_SQUARING();
+  }
+  memcpy(&base, r, sizeof(bbsint));
+  sc->used = mark;
+  return base;
+}
+
+// ---------------------------------------------------------------------------
+//      Low-level, preliminary primality test (fixed size sieve).
+//      Trial division by the sieved small primes, via multiplication with
+//      precomputed reciprocals. Assumes that inputs to the algorithm `p'
+//      are p <= 2^(N_BITS - 1) and further p mod 4 = 3.
+// ---------------------------------------------------------------------------
+static bbs2int * barrett_cache;
+static void populate_barrett_cache(void) {
+  if (trial_gcd) populate_primorial();
+  if (barrett_cache) return;
+  sieve_primes();
+  barrett_cache = huge_alloc(NPRIMES * sizeof(bbs2int));
+  for (unsigned i = 0; i < NPRIMES; i++)
+    barrett_cache[i] = ((bbs2int) -1) / primes[i] + 1;
+}
+static void release_barrett_cache(void) {
+  if (!barrett_cache) return;
+  huge_free(barrett_cache, NPRIMES * sizeof(bbs2int));
+  barrett_cache = NULL;
+}
+static int p_low(bbsint n) {
+  for (unsigned i = 0; i < NPRIMES; i++)
+    if (barrett_cache[i] * n < barrett_cache[i]) return 0;
+  return 1;
+}
+
+// ---------------------------------------------------------------------------
+//      High-level probabilistic primality tests (Fermat to base 2, then
+//      Miller-Rabin). Assumptions are the same as for the low-level test.
+//      Uses binary exponentiation with Barrett reductions for speed. A
+//      candidate that survives trial division gets one context, which
+//      all its exponentiations reuse.
+// ---------------------------------------------------------------------------
+static int ilog2(bbsint n) { int l = 0; while (n >>= 1) l++; return l; }
+// n - 1 = d 2^s with d odd; Miller-Rabin compares its squares with n - 1.
+typedef struct { bbsint n, m1, d; int s; barrett_t red; } cand_t;
+static void cand_init(cand_t * cand, bbsint n) {
+  cand->n = n;  cand->m1 = cand->d = n - 1;  cand->s = 0;
+  while ((cand->d & 1) == 0) { cand->d >>= 1; cand->s++; }
+  barrett_init(&cand->red, n);
+}
+// 2^e mod n for e > 0, left to right: multiplying by the base is a
+// doubling and a subtraction, so only the squarings are reduced.
+static bbsint pow2mod(const cand_t * cand, bbsint e) {
+  union { bbsint v; limb_t l[N_LIMBS]; } r = { 2 };
+  scratch_t * sc = scratch_self();
+  for (int i = ilog2(e) - 1; i >= 0; i--) {
+    mulmod(r.l, r.l, r.l, &cand->red, sc);  PERF_SQUARING();
+    if (e >> i & 1) {
+      r.v <<= 1;
+      if (r.v >= cand->n) r.v -= cand->n;
+    }
+  }
+  return r.v;
+}
+static bbsint csrand(bbsint max, int ilog) {
+  for (;;) {
+    bbsint r; secrandom(&r, N_BITS / 8);
+    if ((r >>= N_BITS - ilog) < max) return r;
+  }
+}
+static int p_high(const cand_t * cand, int iter) {
+  int ilog = ilog2(cand->n - 3);
+  scratch_t * sc = scratch_self();
+  for (int i = 0; i < iter; i++) {
+    bbsint a = 2 + csrand(cand->n - 3, ilog);
+    union { bbsint v; limb_t l[N_LIMBS]; } x;
+    x.v = modexp(a, cand->d, &cand->red, sc);
+    if (x.v == 1 || x.v == cand->m1)
+      continue;
+    int c = 0;
+    for (int r = 1; r < cand->s; r++) {
+      mulmod(x.l, x.l, x.l, &cand->red, sc);
+      if (x.v == cand->m1) { c = 1; break; }
+    }
+    if(!c) return 0;
+  }
+  return 1;
+}
+// p_low as one GCD with the primorial, reduced modulo n first by Horner's
+// rule over k - 1 of its limbs at a time, which keeps each step below
+// n^2. Needs the candidate's context, so it comes first when selected.
+static int p_low_gcd(const cand_t * cand) {
+  const barrett_t * red = &cand->red;  int k = red->k;
+  union { bbsint v; limb_t l[N_LIMBS]; } r = { 0 }, g, n = { cand->n };
+  scratch_t * sc = scratch_self();  size_t mark = sc->used;
+  limb_t * x = scratch_push(sc, 2 * k * sizeof(limb_t));
+  for (int j = (primorial_n - 1) / (k - 1); j >= 0; j--) {
+    int lo = j * (k - 1), len = primorial_n - lo;
+    memset(x, 0, 2 * k * sizeof(limb_t));
+    memcpy(x, primorial + lo, (len < k - 1 ? len : k - 1) * sizeof(limb_t));
+    memcpy(x + k - 1, r.l, k * sizeof(limb_t));
+    barrett_reduce(r.l, x, red, sc);
+  }
+  gcd_n(g.l, r.l, n.l, k, sc);
+  sc->used = mark;
+  return bitlen_n(g.l, k) == 1;
+}
+static int p_test(bbsint n, int iter) {
+  if (!trial_gcd && !p_low(n)) return 0;
+  cand_t cand;  cand_init(&cand, n);
+  if (trial_gcd && !p_low_gcd(&cand)) return 0;
+  return pow2mod(&cand, cand.m1) == 1 && p_high(&cand, iter);
+}
+// Times both trial division engines on the same candidates as
+// prime_search draws, and checks that they agree.
+static void trial_bench(int count) {
+  bbsint * cands = malloc(count * sizeof(bbsint));
+  char * pass = malloc(count);
+  if (!cands || !pass) eprintf("Out of memory.\n");
+  populate_primorial();
+  for (int i = 0; i < count; i++) {
+    bbsint p = csrand((((bbsint) 1) << (N_BITS / 2 - 2)), N_BITS / 2 - 2);
+    cands[i] = 2 * (p | 0b11) + 1;
+  }
+  int passed = 0, agree = 1;
+  double t0 = seconds();
+  for (int i = 0; i < count; i++) passed += pass[i] = p_low(cands[i]);
+  double t1 = seconds();
+  for (int i = 0; i < count; i++) {
+    cand_t cand;  cand_init(&cand, cands[i]);
+    agree &= p_low_gcd(&cand) == pass[i];
+  }
+  double t2 = seconds();
+  printf("Trial division of %d %d-bit candidates (%d pass): residues"
+         " %.1f us, GCD with Barrett setup %.1f us each%s.\n", count,
+         N_BITS / 2 - 1, passed,
+         (t1 - t0) / count * 1e6, (t2 - t1) / count * 1e6,
+         agree ? "" : "; the engines DISAGREE");
+  free(cands);  free(pass);
+}
+
+// ---------------------------------------------------------------------------
+//      Prime number generation for the BBS algorithm. Resulting p, q are
+//      Sophie Germain-safe primes.
+//      Yields correct results in 99.99999999999999999999999999999999997%
+//      of the cases (2^-128 error rate due to ROUNDS = 64 in Miller-Rabin).
+//      `gcd((p-3)/2, (q-3)/2)' should be small for maximised
+//      period length. Not strictly necessary; nmplemented here.
+//      Per Bertrand postulate we always find a suitable prime.
+//      
+//      Optimisation:
+//      We know that k = (p - 1)/2 (so p = 2k + 1) is prime. Then
+//      2^(p - 1) = 1 (mod p) implies that p is prime as well.
+//      In the deterministic test mode, the search is always sequential,
+//      as the parallel one depends on thread scheduling.
+// ---------------------------------------------------------------------------
+// Draws candidates until one is a safe prime other than `other', unless
+// another thread finds one first. The first prime found wins.
+typedef struct { bbsint * out, other; atomic_int found; } prime_job_t;
+static void prime_search(void * arg, int i) {
+  prime_job_t * job = arg;  bbsint p, r;  const int ROUNDS = 64;  (void) i;
+  do {
+    p = csrand((((bbsint) 1) << (N_BITS / 2 - 2)), N_BITS / 2 - 2);
+    p |= 0b11; r = 2 * p + 1;
+  } while (!atomic_load(&job->found) && (r == job->other
+        || !p_test(r, ROUNDS)));
+  int expected = 0;
+  if (atomic_compare_exchange_strong(&job->found, &expected, 1))
+    *job->out = r;
+}
+static void generate_primes(bbsint * p1, bbsint * p2) {
+  int threads = seeded ? 1 : par_threads();
+  prime_job_t job = { p1, 0 };
+  par_run(threads, prime_search, &job);
+  job = (prime_job_t) { p2, *p1 };
+  par_run(threads, prime_search, &job);
+}
+
+// ---------------------------------------------------------------------------
+//      Greatest common divisor and modular inverse, via the word-level
+//      binary GCD on limbs (gcd_n, inv_n). invmod gives the constant
+//      q^-1 mod p with which bbs_set recombines its CRT halves.
+// ---------------------------------------------------------------------------
+static bbsint gcd(bbsint a, bbsint b) {
+  union { bbsint v; limb_t l[N_LIMBS]; } x = { a }, y = { b }, r;
+  gcd_n(r.l, x.l, y.l, N_LIMBS, scratch_self());
+  return r.v;
+}
+// a^-1 mod m for odd m > 1 and a < m, or 0 if there is none.
+static bbsint invmod(bbsint a, bbsint m) {
+  union { bbsint v; limb_t l[N_LIMBS]; } x = { a }, y = { m }, r = { 0 };
+  inv_n(r.l, x.l, y.l, N_LIMBS, scratch_self());
+  return r.v;
+}
+
+// ---------------------------------------------------------------------------
+//      Interface to the Blum Blum Shub generator. What the modulus fixes -
+//      pq, c = lambda(pq), the reduction constants for both and for p and
+//      q, q^-1 mod p and a table of 2^(2^j) mod c for seeking - lives in
+//      a context, which is
+//      read-only once made. A generator is just a
+//      seed, a state and a position over a context, so any number of
+//      them (e.g. one per thread, each with its own seed) can share one
+//      modulus without locking and without paying for the prime search
+//      again. The context must outlive its generators.
+// ---------------------------------------------------------------------------
+typedef struct {
+  bbsint p, q, pq, c;
+  barrett_t red, lam; // Reduction modulo pq and modulo c, respectively.
+  barrett_t rp, rq;   // Reduction modulo p and modulo q.
+  union { bbsint qinv; limb_t qinvl[N_LIMBS]; };  // q^-1 mod p.
+  bbsint pow2[64];    // 2^(2^j) mod c.
+  int shift;          // 2^(2^shift - 1) < c.
+} bbs_ctx_t;
+typedef struct {
+  const bbs_ctx_t * ctx;
+  bbsint x0;
+  union { bbsint x; limb_t xl[N_LIMBS]; };
+  uint64_t pos;
+} bbs_t;
+static const bbs_ctx_t * bbs_ctx_load(bbsint p, bbsint q) {
+  bbs_ctx_t * ctx = malloc(sizeof(bbs_ctx_t));
+  if (!ctx) eprintf("Out of memory.\n");
+  ctx->p = p;  ctx->q = q;  ctx->pq = p * q;
+  // lambda = (p - 1) / g * (q - 1); g is almost always 2, so the
+  // division is nearly always by a single limb.
+  union { bbsint v; limb_t l[N_LIMBS]; } h = { p - 1 };
+  bbsint g = gcd(p - 1, q - 1);
+  if (g >> 64) h.v /= g;
+  else div_1(h.l, h.l, (limb_t) g, N_LIMBS);
+  ctx->c = h.v * (q - 1);
+  barrett_init(&ctx->red, ctx->pq);
+  barrett_init(&ctx->lam, ctx->c);
+  barrett_init(&ctx->rp, p);  barrett_init(&ctx->rq, q);
+  ctx->qinv = invmod(q % p, p);
+  union { bbsint v; limb_t l[N_LIMBS]; } t = { 2 };
+  scratch_t * sc = scratch_self();
+  for (int j = 0; j < 64; j++) {
+    ctx->pow2[j] = t.v;  mulmod(t.l, t.l, t.l, &ctx->lam, sc);
+  }
+  ctx->shift = 0;
+  while ((2 << ctx->shift) - 1 <= ilog2(ctx->c)) ctx->shift++;
+  return ctx;
+}
+static const bbs_ctx_t * bbs_ctx_new(void) {
+  bbsint p, q;  generate_primes(&p, &q);
+  return bbs_ctx_load(p, q);
+}
+static void bbs_ctx_free(const bbs_ctx_t * ctx) { free((void *) ctx); }
+static void bbs_load(bbs_t * bbs, const bbs_ctx_t * ctx, bbsint x0) {
+  bbs->ctx = ctx;
+  bbs->x = bbs->x0 = x0;
+  bbs->pos = 0;
+}
+// A fresh seed in (1, pq), coprime to pq.
+static bbsint bbs_seed(const bbs_ctx_t * ctx) {
+  for (;;) {
+    bbsint x = csrand(ctx->pq, ilog2(ctx->pq));
+    if (x > 1 && gcd(x, ctx->pq) == 1) return x;
+  }
+}
+// A generator with a seed of its own over ctx.
+static void bbs_spawn(bbs_t * bbs, const bbs_ctx_t * ctx) {
+  bbs_load(bbs, ctx, bbs_seed(ctx));
+}
+static void bbs_new(bbs_t * bbs) {
+  TRACE_BEGIN(t0);
+  bbs_spawn(bbs, bbs_ctx_new());
+  TRACE_END("setup", t0);
+}
+static void bbs_step(bbs_t * bbs, scratch_t * sc) {
+  mulmod(bbs->xl, bbs->xl, bbs->xl, &bbs->ctx->red, sc);
+  bbs->pos++;  PERF_SQUARING();
+}
+// e 2^d mod c. The low `shift' bits of d are applied as a shift and one
+// reduction, the others as one multiplication by pow2[j] per set bit j,
+// so seeking to position i costs at most 64 - shift multiplications
+// modulo c instead of the ~96 of modexp(2, i), and none for i < 2^shift.
+static bbsint bbs_advance(const bbs_ctx_t * ctx, bbsint e, uint64_t d,
+                          scratch_t * sc) {
+  union { bbsint v; limb_t l[N_LIMBS]; } r = { e };
+  for (int j = ctx->shift; j < 64; j++)
+    if (d >> j & 1) {
+      union { bbsint v; limb_t l[N_LIMBS]; } t = { ctx->pow2[j] };
+      mulmod(r.l, r.l, t.l, &ctx->lam, sc);
+    }
+  d &= ((uint64_t) 1 << ctx->shift) - 1;
+  if (!d) return r.v;
+  size_t mark = sc->used;
+  limb_t * w = scratch_push(sc, 2 * N_LIMBS * sizeof(limb_t));
+  memcpy(w, r.l, sizeof(r.l));
+  memset(w + N_LIMBS, 0, sizeof(r.l));
+  shl_n(w, w, d, 2 * N_LIMBS);
+  barrett_reduce(r.l, w, &ctx->lam, sc);
+  sc->used = mark;
+  return r.v;
+}
+// x = x0^(2^i mod c) mod pq by the CRT: p - 1 and q - 1 divide c, so
+// the exponent is reduced modulo each, and the powers modulo p and q,
+// of half the size, are recombined as x_q + q ((x_p - x_q) q^-1 mod p).
+// That is a quarter of the work of one exponentiation modulo pq.
+static void bbs_set(bbs_t * bbs, uint64_t i) {
+  PERF_BEGIN();
+  const bbs_ctx_t * ctx = bbs->ctx;
+  scratch_t * sc = scratch_self();
+  bbsint e = bbs_advance(ctx, 1, i, sc);
+  bbsint xp = modexp(bbs->x0 % ctx->p, e % (ctx->p - 1), &ctx->rp, sc);
+  bbsint xq = modexp(bbs->x0 % ctx->q, e % (ctx->q - 1), &ctx->rq, sc);
+  union { bbsint v; limb_t l[N_LIMBS]; } h = { xq % ctx->p };
+  h.v = xp >= h.v ? xp - h.v : xp + ctx->p - h.v;
+  mulmod(h.l, h.l, ctx->qinvl, &ctx->rp, sc);
+  bbs->x = xq + ctx->q * h.v;
+  bbs->pos = i;
+  PERF_END(PERF_SEEK, 0);
+}
+static bbsint bbs_next(bbs_t * bbs, int bits) {
+  bbsint r = 0;  scratch_t * sc = scratch_self();
+  for (int i = bits; i != 0; --i) {
+    bbs_step(bbs, sc); r = (r << 1) | (bbs->x & 1);
+  }
+  return r;
+}
+static uint64_t bbs_next64(bbs_t * bbs) {
+  uint64_t r = 0;  scratch_t * sc = scratch_self();
+  for (int i = 64; i != 0; --i) {
+    bbs_step(bbs, sc); r = (r << 1) | (bbs->x & 1);
+  }
+  return r;
+}
+static void bbs_fill(bbs_t * bbs, uint8_t * buf, size_t len) {
+  TRACE_BEGIN(t0);  PERF_BEGIN();
+  scratch_t * sc = scratch_self();
+  for (size_t i = 0; i < len; i++) {
+    uint8_t r = 0;
+    for (int i = 8; i != 0; --i) {
+      bbs_step(bbs, sc); r = (r << 1) | (bbs->x & 1);
+    }
+    buf[i] = r;
+  }
+  PERF_END(PERF_STEP, len * 8);  TRACE_END("step", t0);
+}
+// Thread i fills the i-th chunk from a clone seeked to its start. The
+// clone lives in the thread's arena, and only the seed and the modulus
+// are copied into it: bbs_set derives the rest.
+typedef struct {
+  const bbs_t * bbs;  uint8_t * buf;  size_t chunk;
+  void (*fill)(bbs_t *, uint8_t *, size_t);
+} part_job_t;
+static void bbs_part(void * arg, int i) {
+  const part_job_t * job = arg;
+  scratch_t * sc = scratch_self();  size_t mark = sc->used;
+  TRACE_BEGIN(t0);
+  bbs_t * clone = scratch_push(sc, sizeof(bbs_t));
+  clone->ctx = job->bbs->ctx;  clone->x0 = job->bbs->x0;
+  bbs_set(clone, job->bbs->pos + i * job->chunk * 8);
+  TRACE_END("seek", t0);
+  job->fill(clone, job->buf + i * job->chunk, job->chunk);
+  sc->used = mark;
+}
+static void bbs_split(bbs_t * bbs, void * bp, size_t len,
+                      void (*fill)(bbs_t *, uint8_t *, size_t)) {
+  uint8_t * buf = bp;
+  size_t threads = par_threads();
+  if (threads == 1 || len < threads) { fill(bbs, buf, len); return; }
+  part_job_t job = { bbs, buf, len / threads, fill };
+  par_run(threads, bbs_part, &job);
+  TRACE_BEGIN(t2);
+  size_t remainder = len % threads;
+  bbs_set(bbs, bbs->pos + (len - remainder) * 8);
+  TRACE_END("handoff", t2);
+  fill(bbs, buf + len - remainder, remainder);
+}
+static void bbs_nextbytes(bbs_t * bbs, void * bp, size_t len) {
+  bbs_split(bbs, bp, len, bbs_fill);
+}
+
+// ---------------------------------------------------------------------------
+//      Substreams for parallel simulations. Substream k of a generator
+//      starts at position k * stride of its sequence, whoever creates it
+//      and whenever. A jump table, built once per seed and stride and
+//      then shared read-only by all workers, makes each start cheap:
+//      t[j] = 2^(stride 2^j) mod c turns k into the exponent with one
+//      multiplication per set bit of k, and g[i] = x0^(2^(8 i)) mod pq
+//      raises x0 to it in fixed-base fashion (Brickell, Gordon, McCurley
+//      and Wilson), with N_BITS / 8 + 255 multiplications instead of the
+//      1.5 N_BITS of modexp.
+// ---------------------------------------------------------------------------
+#define JUMP_DIGITS (N_BITS / 8)
+typedef struct {
+  const bbs_ctx_t * ctx;
+  bbsint x0;
+  uint64_t stride;
+  bbsint t[64];
+  limb_t (*g)[N_LIMBS];
+} bbs_jump_t;
+static void bbs_jump_init(bbs_jump_t * jt, const bbs_t * bbs,
+                          uint64_t stride) {
+  const bbs_ctx_t * ctx = bbs->ctx;  scratch_t * sc = scratch_self();
+  union { bbsint v; limb_t l[N_LIMBS]; } t, g = { bbs->x0 };
+  t.v = bbs_advance(ctx, 1, stride, sc);
+  jt->ctx = ctx;  jt->x0 = bbs->x0;  jt->stride = stride;
+  for (int j = 0; j < 64; j++) {
+    jt->t[j] = t.v;  mulmod(t.l, t.l, t.l, &ctx->lam, sc);
+  }
+  jt->g = huge_alloc(JUMP_DIGITS * sizeof(jt->g[0]));
+  for (int i = 0; i < JUMP_DIGITS; i++) {
+    memcpy(jt->g[i], g.l, sizeof(g.l));
+    for (int j = 0; j < 8; j++) mulmod(g.l, g.l, g.l, &ctx->red, sc);
+  }
+}
+static void bbs_jump_free(bbs_jump_t * jt) {
+  huge_free(jt->g, JUMP_DIGITS * sizeof(jt->g[0]));
+}
+// x0^e mod pq: the product over digits d of (product of g[i] over the
+// base-256 digits e_i >= d).
+static bbsint jump_pow(const bbs_jump_t * jt, bbsint e, scratch_t * sc) {
+  const barrett_t * red = &jt->ctx->red;
+  union { bbsint v; limb_t l[N_LIMBS]; } a = { 1 }, b = { 1 };
+  size_t mark = sc->used;
+  uint8_t * digit = scratch_push(sc, JUMP_DIGITS);
+  for (int i = 0; i < JUMP_DIGITS; i++, e >>= 8) digit[i] = (uint8_t) e;
+  for (int d = 255; d; d--) {
+    for (int i = 0; i < JUMP_DIGITS; i++)
+      if (digit[i] == d) {
+        mulmod(b.l, b.l, jt->g[i], red, sc);  PERF_SQUARING();
+      }
+    mulmod(a.l, a.l, b.l, red, sc);  PERF_SQUARING();
+  }
+  sc->used = mark;
+  return a.v;
+}
+// sub = the generator of jt's seed, at position k * stride.
+static void bbs_substream(bbs_t * sub, const bbs_jump_t * jt, uint64_t k) {
+  if (jt->stride && k > UINT64_MAX / jt->stride)
+    eprintf("Substream position exceeds 2^64.\n");
+  PERF_BEGIN();
+  union { bbsint v; limb_t l[N_LIMBS]; } e = { 1 };
+  scratch_t * sc = scratch_self();
+  for (int j = 0; j < 64; j++)
+    if (k >> j & 1) {
+      union { bbsint v; limb_t l[N_LIMBS]; } t = { jt->t[j] };
+      mulmod(e.l, e.l, t.l, &jt->ctx->lam, sc);
+    }
+  sub->ctx = jt->ctx;  sub->x0 = jt->x0;
+  sub->x = jump_pow(jt, e.v, sc);  sub->pos = k * jt->stride;
+  PERF_END(PERF_SEEK, 0);
+}
+
+// ---------------------------------------------------------------------------
+//      Batch seeks. bbs_seek_many sets out[i] to the generator of bbs's
+//      seed at position pos[i]. The positions are sorted and split into
+//      one run per thread, over a shared stride-1 jump table. Within a
+//      run, the exponent 2^pos mod c is advanced from the previous one by
+//      the bits of the difference, and x0 is raised to it in fixed-base
+//      fashion; a position closer to its predecessor than that costs is
+//      reached by squaring the predecessor's state instead.
+// ---------------------------------------------------------------------------
+typedef struct { uint64_t pos; size_t i; } seek_ent_t;
+static int seek_cmp(const void * a, const void * b) {
+  uint64_t x = ((const seek_ent_t *) a)->pos;
+  uint64_t y = ((const seek_ent_t *) b)->pos;
+  return (x > y) - (x < y);
+}
+typedef struct {
+  const bbs_jump_t * jt;  const seek_ent_t * ent;  bbs_t * out;
+  size_t n, chunk;
+} seek_job_t;
+static void seek_part(void * arg, int t) {
+  const seek_job_t * job = arg;
+  const bbs_jump_t * jt = job->jt;
+  size_t lo = t * job->chunk, hi = lo + job->chunk;
+  union { bbsint v; limb_t l[N_LIMBS]; } e = { 1 }, x = { 0 };
+  uint64_t epos = 0, xpos = 0;
+  scratch_t * sc = scratch_self();
+  if (hi > job->n) hi = job->n;
+  TRACE_BEGIN(t0);  PERF_BEGIN();
+  for (size_t k = lo; k < hi; k++) {
+    uint64_t p = job->ent[k].pos;
+    if (k > lo && p - xpos <= JUMP_DIGITS + 255)
+      for (; xpos < p; xpos++) {
+        mulmod(x.l, x.l, x.l, &jt->ctx->red, sc);  PERF_SQUARING();
+      }
+    else {
+      e.v = bbs_advance(jt->ctx, e.v, p - epos, sc);
+      x.v = jump_pow(jt, e.v, sc);  epos = xpos = p;
+    }
+    bbs_t * o = &job->out[job->ent[k].i];
+    o->ctx = jt->ctx;  o->x0 = jt->x0;  o->x = x.v;  o->pos = p;
+  }
+  PERF_END(PERF_SEEK, 0);  TRACE_END("seek", t0);
+}
+static void bbs_seek_many(const bbs_t * bbs, const uint64_t * pos, size_t n,
+                          bbs_t * out) {
+  if (!n) return;
+  seek_ent_t * ent = malloc(n * sizeof(seek_ent_t));
+  if (!ent) eprintf("Out of memory.\n");
+  for (size_t i = 0; i < n; i++) ent[i] = (seek_ent_t) { pos[i], i };
+  qsort(ent, n, sizeof(seek_ent_t), seek_cmp);
+  bbs_jump_t jt;  bbs_jump_init(&jt, bbs, 1);
+  size_t threads = par_threads();
+  if (threads > n) threads = n;
+  seek_job_t job = { &jt, ent, out, n, (n + threads - 1) / threads };
+  par_run(threads, seek_part, &job);
+  bbs_jump_free(&jt);  free(ent);
+}
+
+// ---------------------------------------------------------------------------
+//      Multi-lane engine. One squaring chain is inherently serial, but
+//      LANES independent chains modulo the same pq can run in lockstep:
+//      limbs are stored structure-of-arrays (limb i of every lane is
+//      contiguous), so each multiply-accumulate is vertical. Lanes are
+//      substreams of one seed. Arithmetic is Montgomery's in radix 2^26.
+//      A column sums up to 2 LANE_LIMBS products below 2^52, more than a
+//      64-bit accumulator holds at 65536 bits, so lanes_dot_run sums runs
+//      of 1024 of them and sets the high bits aside after each.
+// ---------------------------------------------------------------------------
+#define LANE_LIMBS (N_BITS / LANE_BITS + 1) // R = 2^(26 L) > 2 pq.
+typedef struct {
+  lane_t x[LANE_LIMBS];          // Montgomery form of each lane's state.
+  lane_t n[LANE_LIMBS];          // pq, broadcast to all lanes.
+  uint32_t ninv;                 // -pq^-1 mod 2^26.
+  lane_t m[LANE_LIMBS];          // Montgomery quotient digits.
+  lane_t r[LANE_LIMBS];          // x R^-1, whose parity is output.
+  bbsint pq, rmod;               // pq and R mod pq, for conversions.
+} bbs_lanes_t;
+static_assert(sizeof(bbs_lanes_t) + sizeof(bbs_t) + 2 * CACHE_LINE
+              <= FILL_BYTES, "bbs_lanes_t outgrows the arena.");
+
+
+static void lanes_init(bbs_lanes_t * ln, const bbs_t * bbs) {
+  ln->pq = bbs->ctx->pq;
+  ln->rmod = ((bbs2int) 1 << LANE_BITS * LANE_LIMBS) % bbs->ctx->pq;
+  for (int i = 0; i < LANE_LIMBS; i++)
+    for (int l = 0; l < LANES; l++)
+      ln->n[i][l] = (uint32_t) (bbs->ctx->pq >> LANE_BITS * i) & LANE_MASK;
+  // Newton's iteration, 3 -> 32 correct bits, more than the 26 needed.
+  uint32_t inv = ln->n[0][0];
+  for (int i = 0; i < 4; i++) inv *= 2 - ln->n[0][0] * inv;
+  ln->ninv = -inv & LANE_MASK;
+}
+static void lanes_set(bbs_lanes_t * ln, int lane, bbsint x) {
+  bbsint y = ((bbs2int) x) * ln->rmod % ln->pq;
+  for (int i = 0; i < LANE_LIMBS; i++)
+    ln->x[i][lane] = (uint32_t) (y >> LANE_BITS * i) & LANE_MASK;
+}
+// Montgomery reduction in product-scanning form: column k of x^2 (sqr
+// set) or of x is summed together with the m[i] * n[k - i] terms, so the
+// accumulator stays in registers. r = x^2 R^-1 mod pq is fully reduced;
+// r = x R^-1 mod pq needs no final subtraction, as x < R. r may be x.
+static void lanes_mont(bbs_lanes_t * ln, lane_t * r, int sqr) {
+  const lane_t * x = ln->x, * n = ln->n;  lane_t * m = ln->m;
+  uint64_t acc[LANES] = { 0 }, hi[LANES] = { 0 };  // acc + hi 2^32.
+  for (int k = 0; k < 2 * LANE_LIMBS - 1; k++) {
+    int i0 = k < LANE_LIMBS ? 0 : k - LANE_LIMBS + 1;
+    int i1 = k < LANE_LIMBS ? k : LANE_LIMBS;
+    if (sqr) {
+      int h = (k + 1) / 2 - i0;  // Products x[i] x[k - i] with i < k - i.
+      lanes_dot_run(acc, hi, x + i0, x + k - i0 - h + 1, h, 1);
+      if (k % 2 == 0)
+        for (int l = 0; l < LANES; l++)
+          acc[l] += x[k / 2][l] * x[k / 2][l];
+    } else if (k < LANE_LIMBS)
+      for (int l = 0; l < LANES; l++)
+        acc[l] += x[k][l];
+    lanes_dot_run(acc, hi, m + i0, n + k - i1 + 1, i1 - i0, 0);
+    if (k < LANE_LIMBS)
+      for (int l = 0; l < LANES; l++) {
+        m[k][l] = (uint32_t) acc[l] * ln->ninv & LANE_MASK;
+        acc[l] = (acc[l] + m[k][l] * n[0][l]) >> LANE_BITS;
+      }
+    else
+      for (int l = 0; l < LANES; l++) {
+        r[k - LANE_LIMBS][l] = acc[l] & LANE_MASK;  acc[l] >>= LANE_BITS;
+      }
+    for (int l = 0; l < LANES; l++) {
+      acc[l] += hi[l] << (32 - LANE_BITS);  hi[l] = 0;
+    }
+  }
+  for (int l = 0; l < LANES; l++)
+    r[LANE_LIMBS - 1][l] = acc[l];
+  if (!sqr) return;
+  uint64_t b[LANES] = { 0 }, sub[LANES];  // Subtract pq where r >= pq.
+  for (int i = 0; i < LANE_LIMBS; i++)
+    for (int l = 0; l < LANES; l++)
+      b[l] = (r[i][l] - n[i][l] - b[l]) >> 63;
+  for (int l = 0; l < LANES; l++) { sub[l] = !b[l];  b[l] = 0; }
+  for (int i = 0; i < LANE_LIMBS; i++)
+    for (int l = 0; l < LANES; l++) {
+      uint64_t d = r[i][l] - (n[i][l] + b[l]) * sub[l];
+      r[i][l] = d & LANE_MASK;  b[l] = d >> 63;
+    }
+}
+static void lanes_sqr(bbs_lanes_t * ln) { lanes_mont(ln, ln->x, 1); }
+// Parity of every lane's state, i.e. the output bits.
+static unsigned lanes_bits(bbs_lanes_t * ln) {
+  unsigned bits = 0;
+  lanes_mont(ln, ln->r, 0);
+  for (int l = 0; l < LANES; l++)
+    bits |= (ln->r[0][l] & 1) << l;
+  return bits;
+}
+// Lane l writes its `len' bytes to out + l * len.
+static void lanes_nextbytes(bbs_lanes_t * ln, uint8_t * out, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    uint8_t r[LANES] = { 0 };
+    for (int k = 0; k < 8; k++) {
+      lanes_sqr(ln);  PERF_SQUARINGS(LANES);
+      unsigned bits = lanes_bits(ln);
+      for (int l = 0; l < LANES; l++)
+        r[l] = (r[l] << 1) | (bits >> l & 1);
+    }
+    for (int l = 0; l < LANES; l++)
+      out[l * len + i] = r[l];
+  }
+}
+// Same output as bbs_nextbytes: the buffer is split into LANES
+// substreams, each seeked to its first position. The lanes and the clone
+// seeking them live in the calling thread's arena.
+static void bbs_nextbytes_lanes(bbs_t * bbs, void * bp, size_t len) {
+  uint8_t * buf = bp;
+  size_t chunk = len / LANES;
+  if (chunk) {
+    scratch_t * sc = scratch_self();  size_t mark = sc->used;
+    bbs_lanes_t * ln = scratch_push(sc, sizeof(bbs_lanes_t));
+    bbs_t * clone = scratch_push(sc, sizeof(bbs_t));
+    lanes_init(ln, bbs);
+    clone->ctx = bbs->ctx;  clone->x0 = bbs->x0;
+    for (int l = 0; l < LANES; l++) {
+      bbs_set(clone, bbs->pos + l * chunk * 8);
+      lanes_set(ln, l, clone->x);
+    }
+    TRACE_BEGIN(t0);  PERF_BEGIN();
+    lanes_nextbytes(ln, buf, chunk);
+    PERF_END(PERF_STEP, chunk * LANES * 8);  TRACE_END("lanes", t0);
+    sc->used = mark;
+    bbs_set(bbs, bbs->pos + chunk * LANES * 8);
+  }
+  for (size_t i = chunk * LANES; i < len; i++)
+    buf[i] = bbs_next(bbs, 8);
+}
+
+// ---------------------------------------------------------------------------
+//      RNS engine (see bbs.c): the squarings of bbs_fill, done in RNS_N
+//      channels per base. Only the set-up and the rare exact parity need
+//      full-width arithmetic.
+// ---------------------------------------------------------------------------
+#define RNS_N RNS_K(N_BITS)  // 62 RNS_N + 128 < 2 N_BITS, for B 2^128 below.
+static void rns_init(rns_t * rns, const bbs_t * bbs) {
+  const rns_base_t * base = rns_base(RNS_N);
+  union { bbs2int v; limb_t l[2 * N_LIMBS]; } a = { 0 }, b = { 0 }, d;
+  union { bbsint v; limb_t l[N_LIMBS]; } n = { bbs->ctx->pq }, x;
+  memcpy(a.l, base->a, (RNS_N + 1) * sizeof(limb_t));
+  memcpy(b.l, base->b, (RNS_N + 1) * sizeof(limb_t));
+  d.v = (b.v << 128) / bbs->ctx->pq;
+  int dl = 2 * N_LIMBS;
+  while (dl > 1 && !d.l[dl - 1]) dl--;
+  rns_load(rns, base, n.l, N_LIMBS, d.l, dl);
+  x.v = (bbs2int) bbs->x * (a.v % bbs->ctx->pq) % bbs->ctx->pq;
+  rns_set(rns, x.l, N_LIMBS);
+}
+// The plain state, after rns_redc.
+static bbsint rns_exact(const rns_t * rns, const bbs_t * bbs) {
+  union { bbs2int v; limb_t l[2 * N_LIMBS]; } z = { 0 };
+  rns_value(rns, z.l);
+  return z.v % bbs->ctx->pq;
+}
+static void rns_fill(bbs_t * bbs, uint8_t * buf, size_t len) {
+  scratch_t * sc = scratch_self();  size_t mark = sc->used;
+  rns_t * rns = scratch_push(sc, sizeof(rns_t));
+  rns_init(rns, bbs);
+  TRACE_BEGIN(t0);  PERF_BEGIN();
+  for (size_t i = 0; i < len; i++) {
+    uint8_t r = 0;
+    for (int i = 8; i != 0; --i) {
+      rns_sqr(rns);  PERF_SQUARING();
+      int bit = rns_parity(rns);
+      if (bit < 0) bit = rns_exact(rns, bbs) & 1;
+      r = (r << 1) | bit;
+    }
+    buf[i] = r;
+  }
+  PERF_END(PERF_STEP, len * 8);  TRACE_END("rns", t0);
+  rns_redc(rns);
+  bbs->x = rns_exact(rns, bbs);  bbs->pos += len * 8;
+  sc->used = mark;
+}
+// Same output as bbs_nextbytes. The tables are built here, before any
+// worker needs them.
+static void bbs_nextbytes_rns(bbs_t * bbs, void * bp, size_t len) {
+  rns_base(RNS_N);
+  bbs_split(bbs, bp, len, rns_fill);
+}
+
+// ---------------------------------------------------------------------------
+//      Modulus rotation. bbs_rekey_start makes a fresh context and seed
+//      on a low-priority background thread, as the prime search takes
+//      minutes at 8192 bits. Once they are ready, bbs_rekey_swap moves
+//      a generator over to them in constant time, to be called between
+//      two buffers; the generator restarts at position 0 of the new
+//      sequence. The old context is returned to the caller, who frees it
+//      once nothing else (spawned generators, jump tables) refers to it.
+// ---------------------------------------------------------------------------
+typedef struct { const bbs_ctx_t * ctx; bbsint x0; } bbs_key_t;
+typedef struct {
+  _Atomic(bbs_key_t *) ready;         // Made, not yet swapped in.
+  atomic_int pending;                 // Set from start until the swap.
+} bbs_rekey_t;
+static void rekey_job(void * arg) {
+  bbs_rekey_t * rk = arg;
+  TRACE_BEGIN(t0);  PERF_REKEY_BEGIN(t1);
+  bbs_key_t * key = malloc(sizeof(bbs_key_t));
+  if (!key) eprintf("Out of memory.\n");
+  key->ctx = bbs_ctx_new();
+  key->x0 = bbs_seed(key->ctx);
+  PERF_REKEY_END(t1);  TRACE_END("rekey", t0);
+  atomic_store(&rk->ready, key);
+}
+// Returns 0 if a key is already being made or waiting to be swapped in.
+static int bbs_rekey_start(bbs_rekey_t * rk) {
+  if (atomic_exchange(&rk->pending, 1)) return 0;
+  bg_run(rekey_job, rk);
+  return 1;
+}
+// Returns NULL, leaving bbs alone, if the new key is not ready yet.
+static const bbs_ctx_t * bbs_rekey_swap(bbs_rekey_t * rk, bbs_t * bbs) {
+  bbs_key_t * key = atomic_exchange(&rk->ready, NULL);
+  if (!key) return NULL;
+  TRACE_BEGIN(t0);
+  const bbs_ctx_t * old = bbs->ctx;
+  bbs_load(bbs, key->ctx, key->x0);
+  free(key);
+  atomic_store(&rk->pending, 0);
+  TRACE_END("swap", t0);  PERF_SWAP();
+  return old;
+}
+
+// ---------------------------------------------------------------------------
+//      Fixed parameters and known-answer tests for this size, and the
+//      size-erased entry points used by the CLI.
+// ---------------------------------------------------------------------------
+static bbsint parse_hex(const char * s) {
+  bbsint r = 0;
+  if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) s += 2;
+  if (!*s) eprintf("Empty hexadecimal number.\n");
+  for (; *s; s++) {
+    int d;
+    if (*s >= '0' && *s <= '9') d = *s - '0';
+    else if (*s >= 'a' && *s <= 'f') d = *s - 'a' + 10;
+    else if (*s >= 'A' && *s <= 'F') d = *s - 'A' + 10;
+    else eprintf("Invalid hexadecimal digit `%c'.\n", *s);
+    if (r >> (N_BITS - 4)) eprintf("Number exceeds %d bits.\n", N_BITS);
+    r = (r << 4) | d;
+  }
+  return r;
+}
+static void print_hex(FILE * f, const char * key, bbsint v) {
+  char s[N_BITS / 4 + 1], * e = s + N_BITS / 4;
+  *e = 0;
+  do *--e = "0123456789abcdef"[(unsigned) (v & 15)]; while (v >>= 4);
+  fprintf(f, "%s %s\n", key, e);
+}
+// The seed `xs', or a fresh one if it is NULL.
+static void load_seed(bbs_t * bbs, const bbs_ctx_t * ctx, const char * xs) {
+  bbsint x;
+  if (xs) {
+    x = parse_hex(xs);
+    if (x <= 1 || x >= ctx->pq || x % ctx->p == 0 || x % ctx->q == 0)
+      eprintf("x must lie in (1, pq) and be coprime to pq.\n");
+  } else x = bbs_seed(ctx);
+  bbs_load(bbs, ctx, x);
+}
+static void load_fixed(bbs_t * bbs, const char * ps, const char * qs,
+                       const char * xs) {
+  bbsint p = parse_hex(ps), q = parse_hex(qs);
+  if (p % 4 != 3 || q % 4 != 3 || p == q)
+    eprintf("p and q must be distinct primes congruent to 3 mod 4.\n");
+  if (ilog2(p) + ilog2(q) + 2 > N_BITS)
+    eprintf("p * q exceeds %d bits.\n", N_BITS);
+  load_seed(bbs, bbs_ctx_load(p, q), xs);
+}
+static int run_kat(void) {
+  const bbs_kat * kat = NULL;
+  for (size_t i = 0; i < sizeof(kats) / sizeof(kats[0]); i++)
+    if (kats[i].bits == N_BITS) kat = &kats[i];
+  if (!kat) {
+    printf("No known-answer vectors for %d bits.\n", N_BITS);
+    return 0;
+  }
+  // The batch path seeks to all positions at once, in reverse order.
+  bbs_t ref, batch[KAT_VECTORS];  uint64_t pos[KAT_VECTORS];
+  load_fixed(&ref, kat->p, kat->q, kat->x0);
+  for (int i = 0; i < KAT_VECTORS; i++)
+    pos[i] = kat->v[KAT_VECTORS - 1 - i].pos;
+  bbs_seek_many(&ref, pos, KAT_VECTORS, batch);
+  // bbs_set recombines with q^-1 mod p; the vectors check the rest.
+  const bbs_ctx_t * rc = ref.ctx;
+  int failed = rc->qinv * (rc->q % rc->p) % rc->p != 1;
+  if (failed) printf("KAT %d-bit: q^-1 mod p FAILED\n", N_BITS);
+  for (int i = 0; i < KAT_VECTORS; i++) {
+    bbs_t bbs, sub;  bbs_jump_t jt;  uint8_t buf[32];
+    char par[65], seq[65], lanes[65], rns[65], jump[65], many[65];
+    load_fixed(&bbs, kat->p, kat->q, kat->x0);
+    bbs_set(&bbs, kat->v[i].pos);
+    bbs_nextbytes(&bbs, buf, 32);
+    for (int j = 0; j < 32; j++)
+      sprintf(par + 2 * j, "%02x", buf[j]);
+    bbs_set(&bbs, kat->v[i].pos);
+    for (int j = 0; j < 32; j++)
+      sprintf(seq + 2 * j, "%02x", (unsigned) bbs_next(&bbs, 8));
+    bbs_set(&bbs, kat->v[i].pos);
+    bbs_nextbytes_lanes(&bbs, buf, 32);
+    for (int j = 0; j < 32; j++)
+      sprintf(lanes + 2 * j, "%02x", buf[j]);
+    bbs_set(&bbs, kat->v[i].pos);
+    bbs_nextbytes_rns(&bbs, buf, 32);
+    for (int j = 0; j < 32; j++)
+      sprintf(rns + 2 * j, "%02x", buf[j]);
+    bbs_jump_init(&jt, &bbs, 1);
+    bbs_substream(&sub, &jt, kat->v[i].pos);
+    bbs_jump_free(&jt);
+    bbs_nextbytes(&sub, buf, 32);
+    for (int j = 0; j < 32; j++)
+      sprintf(jump + 2 * j, "%02x", buf[j]);
+    bbs_nextbytes(&batch[KAT_VECTORS - 1 - i], buf, 32);
+    for (int j = 0; j < 32; j++)
+      sprintf(many + 2 * j, "%02x", buf[j]);
+    int ok = !strcmp(par, kat->v[i].out) && !strcmp(seq, kat->v[i].out)
+          && !strcmp(lanes, kat->v[i].out) && !strcmp(rns, kat->v[i].out)
+          && !strcmp(jump, kat->v[i].out) && !strcmp(many, kat->v[i].out);
+    printf("KAT %d-bit @ %u: %s\n", N_BITS, kat->v[i].pos,
+           ok ? "ok" : "FAILED");
+    failed += !ok;
+    bbs_ctx_free(bbs.ctx);
+  }
+  bbs_ctx_free(ref.ctx);
+  return failed != 0;
+}
+
+static void op_new(void * bbs) { bbs_new(bbs); }
+static void op_spawn(void * bbs, const void * parent, const char * x) {
+  load_seed(bbs, ((const bbs_t *) parent)->ctx, x);
+}
+static void op_release(void * bbs) { bbs_ctx_free(((bbs_t *) bbs)->ctx); }
+static void op_load(void * bbs, const char * p, const char * q,
+                    const char * x) { load_fixed(bbs, p, q, x); }
+static void op_save(const void * bbs, FILE * f) {
+  const bbs_t * b = bbs;
+  print_hex(f, "p", b->ctx->p);
+  print_hex(f, "q", b->ctx->q);
+  print_hex(f, "x", b->x0);
+}
+// The CLI rotates one generator per size at a time.
+static bbs_rekey_t rekeyer;
+static void op_rekey(void) { bbs_rekey_start(&rekeyer); }
+static int op_swap(void * bbs) {
+  const bbs_ctx_t * old = bbs_rekey_swap(&rekeyer, bbs);
+  if (old) bbs_ctx_free(old);
+  return old != NULL;
+}
+static void op_set(void * bbs, uint64_t i) { bbs_set(bbs, i); }
+static uint64_t op_tell(const void * bbs) {
+  return ((const bbs_t *) bbs)->pos;
+}
+static void op_substream(void * sub, const void * bbs, uint64_t k,
+                         uint64_t stride) {
+  bbs_jump_t jt;  bbs_jump_init(&jt, bbs, stride);
+  bbs_substream(sub, &jt, k);
+  bbs_jump_free(&jt);
+}
+static void op_nextbytes(void * bbs, void * buf, size_t len) {
+  bbs_nextbytes(bbs, buf, len);
+}
+static void op_nextbytes_lanes(void * bbs, void * buf, size_t len) {
+  bbs_nextbytes_lanes(bbs, buf, len);
+}
+static void op_nextbytes_rns(void * bbs, void * buf, size_t len) {
+  bbs_nextbytes_rns(bbs, buf, len);
+}
+static const bbs_ops_t ops = {
+  N_BITS, sizeof(bbs_t), populate_barrett_cache, release_barrett_cache,
+  op_new, op_load, op_save, op_spawn, op_release, op_rekey, op_swap, op_set,
+  op_tell, op_substream, op_nextbytes, op_nextbytes_lanes, op_nextbytes_rns,
+  run_kat, trial_bench
+};
+
+#undef N_LIMBS
+#undef LANE_LIMBS
+#undef JUMP_DIGITS
+#undef RNS_N
+#undef bbsint
+#undef bbs2int
+#undef barrett_cache
+#undef populate_barrett_cache
+#undef release_barrett_cache
+#undef p_low
+#undef ilog2
+#undef csrand
+#undef cand_t
+#undef cand_init
+#undef pow2mod
+#undef p_high
+#undef p_low_gcd
+#undef p_test
+#undef trial_bench
+#undef prime_job_t
+#undef prime_search
+#undef generate_primes
+#undef gcd
+#undef invmod
+#undef barrett_t
+#undef barrett_init
+#undef barrett_reduce
+#undef mulmod
+#undef bbs_ctx_t
+#undef bbs_ctx_load
+#undef bbs_ctx_new
+#undef bbs_ctx_free
+#undef bbs_t
+#undef bbs_load
+#undef bbs_seed
+#undef bbs_spawn
+#undef bbs_new
+#undef bbs_step
+#undef bbs_advance
+#undef modexp
+#undef bbs_set
+#undef bbs_next
+#undef bbs_next64
+#undef bbs_fill
+#undef part_job_t
+#undef bbs_part
+#undef bbs_split
+#undef bbs_nextbytes
+#undef bbs_jump_t
+#undef bbs_jump_init
+#undef bbs_jump_free
+#undef jump_pow
+#undef bbs_substream
+#undef seek_ent_t
+#undef seek_cmp
+#undef seek_job_t
+#undef seek_part
+#undef bbs_seek_many
+#undef bbs_lanes_t
+#undef lanes_init
+#undef lanes_set
+#undef lanes_mont
+#undef lanes_sqr
+#undef lanes_bits
+#undef lanes_nextbytes
+#undef bbs_nextbytes_lanes
+#undef rns_init
+#undef rns_exact
+#undef rns_fill
+#undef bbs_nextbytes_rns
+#undef bbs_key_t
+#undef bbs_rekey_t
+#undef rekey_job
+#undef bbs_rekey_start
+#undef bbs_rekey_swap
+#undef parse_hex
+#undef print_hex
+#undef load_seed
+#undef load_fixed
+#undef run_kat
+#undef op_new
+#undef op_load
+#undef op_save
+#undef op_spawn
+#undef op_release
+#undef rekeyer
+#undef op_rekey
+#undef op_swap
+#undef op_set
+#undef op_tell
+#undef op_substream
+#undef op_nextbytes
+#undef op_nextbytes_lanes
+#undef op_nextbytes_rns
+#undef ops
@@ -3,6 +3,7 @@
 //      random number generator. Written and released to the public
 //      domain by Kamila Szewczyk.
 // ---------------------------------------------------------------------------
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -10,27 +11,34 @@
 #include <stdarg.h>
 #include <math.h>
 #include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <limits.h>
 
+#if defined(OPENMP) && defined(PTHREADS)
+  #error "Choose one of OPENMP and PTHREADS."
+#endif
 #ifdef OPENMP
   #include <omp.h>
 #endif
+#ifdef PTHREADS
+  #include <pthread.h>
+  #include <unistd.h>
+#endif
 
 // ---------------------------------------------------------------------------
-//      Bit integers and OpenMP detection code.
+//      Modulus sizes. log2(pq) is selected at runtime with `-N bits' among
+//      the sizes instantiated at the end of this file (see bbs-core.h).
+//      For tangible security use at least 8192 bits.
+//      For demonstration, 512 bits will do. -DLARGE adds 16384, 32768
+//      and 65536 bits, which need a compiler with _BitInt(131072).
 // ---------------------------------------------------------------------------
-// Define s.t. desired log2(pq) --> N_BITS.
-// For tangible security set at least N_BITS = 8192.
-// For demonstration, set N_BITS = 512.
-#define N_BITS 8192
-
-typedef unsigned _BitInt(N_BITS) bbsint;
-typedef unsigned _BitInt(N_BITS * 2) bbs2int;
-
-#if N_BITS > 1024
-  #ifndef OPENMP
-    #error "That won't work."
-  #endif
+#ifdef LARGE
+  #define MAX_BITS 65536
+#else
+  #define MAX_BITS 8192
 #endif
+#define DEFAULT_BITS 8192
 
 // ---------------------------------------------------------------------------
 //      Cryptographically secure random number source. Used
@@ -43,6 +51,10 @@ static void eprintf(const char * fmt, ...) {
   va_end(args);
   exit(1);
 }
+static double seconds(void) {
+  struct timespec ts;  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
 #ifdef _WIN32
 #include <windows.h>
@@ -52,9 +64,10 @@ static HCRYPTPROV hp;
 static void init_secrandom(void) {
   CryptAcquireContext(&hp, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT);
 }
-static void secrandom(void * buf, size_t len) {
+static void sysrandom(void * buf, size_t len) {
   CryptGenRandom(hp, len, buf);
 }
+static void close_secrandom(void) { CryptReleaseContext(hp, 0); }
 #elif __unix__
 #include <fcntl.h>
 #include <unistd.h>
@@ -64,9 +77,10 @@ static void init_secrandom(void) {
   if (fd < 0)
     eprintf("Could not open `/dev/urandom': %s\n", strerror(errno));
 }
-static void secrandom(void * buf, size_t len) {
+static void sysrandom(void * buf, size_t len) {
   read(fd, buf, len);
 }
+static void close_secrandom(void) { close(fd); }
 #elif __MSDOS__
 static FILE * f;
 static void init_secrandom(void) {
@@ -74,21 +88,495 @@ static void init_secrandom(void) {
   if (!f)
     eprintf("Could not open `/dev/urandom$': %s\n", strerror(errno));
 }
-static void secrandom(void * buf, size_t len) { // Doug Kaufman's NOISE.SYS
+static void sysrandom(void * buf, size_t len) { // Doug Kaufman's NOISE.SYS
   fread(buf, 1, len, f);
 }
+static void close_secrandom(void) { fclose(f); }
+#endif
+
+// Deterministic test mode: once seeded, all entropy (primes, seeds and
+// Miller-Rabin witnesses) comes from a SplitMix64 stream instead, so that
+// runs can be reproduced exactly. Never use this for real keystreams.
+static int seeded;
+static uint64_t seed_state;
+#ifndef LIBRARY
+static void seed_secrandom(uint64_t seed) { seeded = 1; seed_state = seed; }
+#endif
+static void secrandom(void * buf, size_t len) {
+  if (!seeded) { sysrandom(buf, len); return; }
+  for (uint8_t * p = buf; len; ) {
+    uint64_t z = (seed_state += 0x9E3779B97F4A7C15);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    z ^= z >> 31;
+    size_t n = len < 8 ? len : 8;
+    memcpy(p, &z, n);  p += n;  len -= n;
+  }
+}
+
+// ---------------------------------------------------------------------------
+//      Large buffers: output buffers and precomputed tables. On Linux, they
+//      are backed by explicit huge pages (MAP_HUGETLB) if some are reserved,
+//      and otherwise by anonymous memory aligned to and advised for
+//      transparent huge pages. $BBS_HUGEPAGES=0 makes them plain malloc
+//      blocks. Usage of each kind is tallied for the -DPERF report.
+// ---------------------------------------------------------------------------
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+enum { MEM_HUGETLB, MEM_THP, MEM_MALLOC, MEM_KINDS };
+static atomic_ullong mem_bytes[MEM_KINDS];
+#if defined(__linux__) && defined(MAP_HUGETLB)
+  #define HUGE_PAGE ((size_t) 2 << 20)
+  #define HUGE_ROUND(n) (((n) + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1))
+  static int mem_plain;
+  // Read once by cbbs_init or main, before any other thread can allocate.
+  static void mem_init(void) {
+    const char * env = getenv("BBS_HUGEPAGES");
+    mem_plain = env && !atoi(env);
+  }
+#else
+  enum { mem_plain = 1 };
+  static void mem_init(void) { }
+#endif
+static void * huge_alloc(size_t len) {
+#if defined(__linux__) && defined(MAP_HUGETLB)
+  if (!mem_plain) {
+    size_t n = HUGE_ROUND(len);
+    char * p = mmap(NULL, n, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) { mem_bytes[MEM_HUGETLB] += n;  return p; }
+    // Map a huge page more than needed and trim it to an aligned range.
+    p = mmap(NULL, n + HUGE_PAGE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) eprintf("Out of memory.\n");
+    size_t head = -(uintptr_t) p & (HUGE_PAGE - 1);
+    if (head) munmap(p, head);
+    munmap(p + head + n, HUGE_PAGE - head);
+    p += head;
+  #ifdef MADV_HUGEPAGE
+    madvise(p, n, MADV_HUGEPAGE);
+  #endif
+    mem_bytes[MEM_THP] += n;
+    return p;
+  }
+#endif
+  void * p = malloc(len);
+  if (!p) eprintf("Out of memory.\n");
+  mem_bytes[MEM_MALLOC] += len;
+  return p;
+}
+static void huge_free(void * p, size_t len) {
+#if defined(__linux__) && defined(MAP_HUGETLB)
+  if (!mem_plain) { munmap(p, HUGE_ROUND(len));  return; }
+#endif
+  (void) len;  free(p);
+}
+
+// ---------------------------------------------------------------------------
+//      Scratch arenas. The temporaries of the arithmetic (products,
+//      Barrett quotients, Toom-3 buffers, a worker's clone of the
+//      generator, the lane and RNS engines) grow with the modulus, to
+//      over 150 KiB at 65536 bits and 650 KiB with the lanes:
+//      too much for the stacks of threads that libcbbs users start. Each
+//      thread owns one cache-line aligned arena instead, allocated on its
+//      first use and so on its own NUMA node, and hands it down to the
+//      kernels explicitly. Taking memory bumps `used'; whoever takes some
+//      restores the old mark before returning, so the hot path never
+//      calls malloc.
+// ---------------------------------------------------------------------------
+#define MAX_LIMBS (MAX_BITS / 64 + 1)  // Barrett multiplies k + 1 limbs.
+#define CACHE_LINE 64
+// A worker's clone, modexp, mulmod and barrett_reduce take up to 12
+// MAX_LIMBS limbs, Toom-3 below them 8 over its recursion. The rest is
+// headroom. A fill's lane or RNS state (bbs-core.h) comes on top: four
+// vectors of MAX_BITS / 26 + 1 eight-lane digits, and a few moduli.
+#define FILL_BYTES ((size_t) 4 * 64 * (MAX_BITS / 26 + 1) + MAX_BITS)
+#define SCRATCH_BYTES ((size_t) 40 * MAX_LIMBS * 8 + FILL_BYTES)
+typedef struct { void * raw;  uint8_t * base;  size_t used; } scratch_t;
+static _Thread_local scratch_t scratch_own;
+static scratch_t * scratch_self(void) {
+  scratch_t * sc = &scratch_own;
+  if (!sc->base) {
+    if (!(sc->raw = malloc(SCRATCH_BYTES + CACHE_LINE)))
+      eprintf("Out of memory.\n");
+    sc->base = (uint8_t *) sc->raw + (-(uintptr_t) sc->raw & (CACHE_LINE - 1));
+  }
+  return sc;
+}
+static void * scratch_push(scratch_t * sc, size_t len) {
+  void * p = sc->base + sc->used;
+  sc->used += (len + CACHE_LINE - 1) & ~(size_t) (CACHE_LINE - 1);
+  if (sc->used > SCRATCH_BYTES) eprintf("Scratch arena exhausted.\n");
+  return p;
+}
+// Frees the calling thread's arena; the next use allocates it again.
+static void scratch_free(void) {
+  free(scratch_own.raw);
+  scratch_own = (scratch_t) { 0 };
+}
+
+// ---------------------------------------------------------------------------
+//      Optional timeline tracing (compile with -DTRACE). Every thread
+//      appends spans to a buffer of its own, so recording never takes
+//      a lock. At exit, all buffers are dumped as Chrome trace event JSON
+//      to the file named by $BBS_TRACE (default `bbs-trace.json'), which
+//      can be loaded into chrome://tracing or Perfetto.
+// ---------------------------------------------------------------------------
+#ifdef TRACE
+#include <signal.h>
+#define TRACE_THREADS 256
+#define TRACE_SPANS 65536
+typedef struct { const char * name; double ts, dur; } trace_span;
+typedef struct { int tid, n, dropped; trace_span s[TRACE_SPANS]; } trace_buf;
+static trace_buf * trace_bufs[TRACE_THREADS];
+static atomic_int trace_nbufs;
+static _Thread_local trace_buf * trace_self;
+static double trace_now(void) {
+  struct timespec ts;  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+static void trace_dump(void) {
+  const char * path = getenv("BBS_TRACE");
+  FILE * f = fopen(path ? path : "bbs-trace.json", "w");
+  if (!f) return;
+  int n = trace_nbufs < TRACE_THREADS ? trace_nbufs : TRACE_THREADS;
+  const char * sep = "";
+  fprintf(f, "{\"traceEvents\":[");
+  for (int i = 0; i < n; i++) {
+    trace_buf * b = trace_bufs[i];
+    if (!b) continue;
+    fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+               "\"tid\":%d,\"args\":{\"name\":\"worker %d\"}}",
+            sep, b->tid, b->tid);
+    sep = ",";
+    for (int j = 0; j < b->n; j++)
+      fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                 "\"ts\":%.3f,\"dur\":%.3f}",
+              b->s[j].name, b->tid, b->s[j].ts, b->s[j].dur);
+    if (b->dropped)
+      fprintf(stderr, "trace: thread %d dropped %d spans\n", b->tid, b->dropped);
+  }
+  fprintf(f, "\n]}\n");
+  fclose(f);
+}
+static void trace_span_add(const char * name, double ts) {
+  double end = trace_now();
+  if (!trace_self) {
+    int tid = atomic_fetch_add(&trace_nbufs, 1);
+    if (tid >= TRACE_THREADS) return;
+    trace_self = calloc(1, sizeof(trace_buf));
+    if (!trace_self) return;
+    trace_self->tid = tid;  trace_bufs[tid] = trace_self;
+    if (tid == 0) atexit(trace_dump);
+  }
+  if (trace_self->n == TRACE_SPANS) { trace_self->dropped++; return; }
+  trace_self->s[trace_self->n++] = (trace_span) { name, ts, end - ts };
+}
+  #define TRACE_BEGIN(v) double v = trace_now()
+  #define TRACE_END(name, v) trace_span_add(name, v)
+#else
+  #define TRACE_BEGIN(v)
+  #define TRACE_END(name, v)
+#endif
+
+// ---------------------------------------------------------------------------
+//      Optional hardware counters (compile with -DPERF, Linux only).
+//      Cycles, instructions, cache misses and branch misses are counted
+//      with perf_event_open around the stepping loops and the seeking
+//      exponentiations, separately for each thread. At exit, totals are
+//      reported per generated bit and per modular squaring (modexp
+//      multiplications are counted as squarings), along with the moduli
+//      made by background rotation and the time spent making them.
+// ---------------------------------------------------------------------------
+#ifdef PERF
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+enum { PERF_STEP, PERF_SEEK, PERF_NREGIONS };
+enum { PERF_NCOUNTERS = 4 };
+static const char * perf_region_names[PERF_NREGIONS] = { "step", "seek" };
+static const char * perf_counter_names[PERF_NCOUNTERS] = {
+  "cycles", "instructions", "cache-misses", "branch-misses"
+};
+static const unsigned long long perf_configs[PERF_NCOUNTERS] = {
+  PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+static atomic_ullong perf_totals[PERF_NREGIONS][PERF_NCOUNTERS];
+static atomic_ullong perf_bits[PERF_NREGIONS], perf_sqrs[PERF_NREGIONS];
+static atomic_int perf_errno;
+static _Thread_local int perf_fd = -2, perf_slot[PERF_NCOUNTERS];
+static _Thread_local unsigned long long perf_sq, perf_sq0;
+static atomic_ullong perf_rekeys, perf_rekey_us, perf_swaps;
+static unsigned long long perf_usec(void) {
+  struct timespec ts;  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+// Huge page usage: bytes allocated by huge_alloc, and how much anonymous
+// memory the kernel actually backs with transparent huge pages.
+static void perf_memory(void) {
+  static const char * names[MEM_KINDS] = { "hugetlb", "thp-advised", "malloc" };
+  fprintf(stderr, "perf: memory:");
+  for (int k = 0; k < MEM_KINDS; k++)
+    fprintf(stderr, " %.1f MiB %s%s", mem_bytes[k] / 1048576.0,
+            names[k], k + 1 < MEM_KINDS ? "," : "");
+  FILE * f = fopen("/proc/self/smaps_rollup", "r");
+  char line[128];  unsigned long kb;
+  while (f && fgets(line, sizeof(line), f))
+    if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+      fprintf(stderr, "; %.1f MiB in transparent huge pages at exit",
+              kb / 1024.0);
+  if (f) fclose(f);
+  fprintf(stderr, "\n");
+}
+static void perf_report(void) {
+  if (perf_errno)
+    fprintf(stderr, "perf: counters unavailable: %s\n", strerror(perf_errno));
+  perf_memory();
+  if (perf_rekeys)
+    fprintf(stderr, "perf: rekey: %llu moduli made in %.3f s, %llu swapped"
+            " in\n", (unsigned long long) perf_rekeys, perf_rekey_us / 1e6,
+            (unsigned long long) perf_swaps);
+  for (int r = 0; r < PERF_NREGIONS; r++) {
+    unsigned long long bits = perf_bits[r], sqrs = perf_sqrs[r];
+    if (!sqrs) continue;
+    fprintf(stderr, "perf: %s: %llu bits, %llu squarings\n",
+            perf_region_names[r], bits, sqrs);
+    for (int c = 0; c < PERF_NCOUNTERS; c++) {
+      double v = perf_totals[r][c];
+      fprintf(stderr, "perf:   %-14s %16.0f", perf_counter_names[c], v);
+      if (bits) fprintf(stderr, "  %12.2f/bit", v / bits);
+      fprintf(stderr, "  %12.2f/squaring\n", v / sqrs);
+    }
+  }
+}
+static void perf_open(void) {
+  static atomic_int registered;
+  if (!atomic_exchange(&registered, 1)) atexit(perf_report);
+  perf_fd = -1;
+  for (int c = 0, n = 0; c < PERF_NCOUNTERS; c++) {
+    struct perf_event_attr attr = { 0 };
+    attr.size = sizeof(attr);  attr.type = PERF_TYPE_HARDWARE;
+    attr.config = perf_configs[c];  attr.disabled = perf_fd < 0;
+    attr.exclude_kernel = 1;  attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, perf_fd, 0);
+    if (fd < 0 && c == 0) { perf_errno = errno; return; }
+    perf_slot[c] = fd < 0 ? -1 : n++;
+    if (c == 0) perf_fd = fd;
+  }
+}
+static void perf_begin(void) {
+  if (perf_fd == -2) perf_open();
+  if (perf_fd < 0) return;
+  perf_sq0 = perf_sq;
+  ioctl(perf_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+static void perf_end(int region, unsigned long long bits) {
+  if (perf_fd < 0) return;
+  ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  unsigned long long v[1 + PERF_NCOUNTERS];
+  if (read(perf_fd, v, sizeof(v)) < (ssize_t) sizeof(v[0])) return;
+  for (int c = 0; c < PERF_NCOUNTERS; c++)
+    if (perf_slot[c] >= 0 && (unsigned long long) perf_slot[c] < v[0])
+      perf_totals[region][c] += v[1 + perf_slot[c]];
+  perf_bits[region] += bits;  perf_sqrs[region] += perf_sq - perf_sq0;
+}
+  #define PERF_BEGIN() perf_begin()
+  #define PERF_END(region, bits) perf_end(region, bits)
+  #define PERF_SQUARINGS(n) perf_sq += (n)
+  #define PERF_REKEY_BEGIN(v) unsigned long long v = perf_usec()
+  #define PERF_REKEY_END(v) (perf_rekeys++, perf_rekey_us += perf_usec() - v)
+  #define PERF_SWAP() perf_swaps++
+#else
+  #define PERF_BEGIN()
+  #define PERF_END(region, bits)
+  #define PERF_SQUARINGS(n)
+  #define PERF_REKEY_BEGIN(v)
+  #define PERF_REKEY_END(v)
+  #define PERF_SWAP()
+#endif
+#define PERF_SQUARING() PERF_SQUARINGS(1)
+
+// ---------------------------------------------------------------------------
+//      Parallel backends. par_run(n, fn, arg) calls fn(arg, i) for every
+//      i < n, spread over par_threads() threads, and returns once all
+//      calls have. With -DOPENMP, this is an OpenMP loop (OMP_NUM_THREADS
+//      threads). With -DPTHREADS, a pool of $BBS_THREADS threads (default:
+//      one per online CPU) is started on first use and kept for the rest
+//      of the run, so per-thread trace buffers and counters are reused.
+//      On Linux hosts with several NUMA nodes, the pool is pinned: workers
+//      are given to nodes in contiguous blocks and confined to the CPUs of
+//      their node ($BBS_PIN=0 turns this off). As worker i fills chunk i of
+//      an output buffer, and is the first to touch it, every chunk and the
+//      generator clone filling it stay on one node. The calling thread
+//      only waits, so its own affinity is never changed.
+//      Otherwise, everything runs on the calling thread.
+// ---------------------------------------------------------------------------
+typedef void (*par_fn)(void * arg, int i);
+#if defined(OPENMP)
+static int par_threads(void) { return omp_get_max_threads(); }
+static void par_loop(int n, par_fn fn, void * arg) {
+  #pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; i++) fn(arg, i);
+}
+#elif defined(PTHREADS)
+static int par_nthreads;
+static pthread_once_t par_once = PTHREAD_ONCE_INIT;
+static void par_count(void) {
+  const char * env = getenv("BBS_THREADS");
+  par_nthreads = env ? atoi(env) : sysconf(_SC_NPROCESSORS_ONLN);
+  if (par_nthreads < 1) par_nthreads = 1;
+}
+// Library threads may ask first, so the count is taken exactly once.
+static int par_threads(void) {
+  pthread_once(&par_once, par_count);
+  return par_nthreads;
+}
+// Workers sleep until par_gen changes; worker w then runs the indices
+// i = w (mod par_nthreads) while the caller waits. Callers on different
+// threads take turns on par_entry.
+static pthread_mutex_t par_entry = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t par_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t par_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t par_done = PTHREAD_COND_INITIALIZER;
+static par_fn par_job;
+static void * par_arg;
+static int par_n, par_gen, par_left;
+static void par_slice(int w, par_fn fn, void * arg, int n) {
+  for (int i = w; i < n; i += par_nthreads) fn(arg, i);
+}
+#if defined(__linux__)
+#include <sched.h>
+#define PAR_NODES 64
+static cpu_set_t par_nodes[PAR_NODES];
+static int par_nnodes;
+// Reads the CPUs of every NUMA node with CPUs from sysfs, restricted
+// to those the process may run on.
+static void par_topology(void) {
+  cpu_set_t allowed;
+  const char * env = getenv("BBS_PIN");
+  if ((env && !atoi(env)) || sched_getaffinity(0, sizeof(allowed), &allowed))
+    return;
+  for (int node = 0; par_nnodes < PAR_NODES; node++) {
+    char path[64];  int a, b, c;  cpu_set_t * set = &par_nodes[par_nnodes];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/node/node%d/cpulist", node);
+    FILE * f = fopen(path, "r");
+    if (!f) break;
+    CPU_ZERO(set);
+    while (fscanf(f, "%d", &a) == 1) {
+      b = a;
+      if ((c = fgetc(f)) == '-') {
+        if (fscanf(f, "%d", &b) != 1) break;
+        c = fgetc(f);
+      }
+      for (; a <= b && a < CPU_SETSIZE; a++) CPU_SET(a, set);
+      if (c != ',') break;
+    }
+    fclose(f);
+    CPU_AND(set, set, &allowed);
+    if (CPU_COUNT(set)) par_nnodes++;
+  }
+}
+static void par_pin(int w) {
+  if (par_nnodes < 2) return;
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                         &par_nodes[(long) w * par_nnodes / par_nthreads]);
+}
+#else
+static void par_topology(void) { }
+static void par_pin(int w) { (void) w; }
+#endif
+static void * par_worker(void * p) {
+  int w = (int) (intptr_t) p, gen = 0;
+  par_pin(w);
+  pthread_mutex_lock(&par_lock);
+  for (;;) {
+    while (par_gen == gen) pthread_cond_wait(&par_wake, &par_lock);
+    gen = par_gen;
+    par_fn fn = par_job;  void * arg = par_arg;  int n = par_n;
+    pthread_mutex_unlock(&par_lock);
+    par_slice(w, fn, arg, n);
+    pthread_mutex_lock(&par_lock);
+    if (--par_left == 0) pthread_cond_signal(&par_done);
+  }
+  return NULL;
+}
+static void par_loop(int n, par_fn fn, void * arg) {
+  static int started;
+  pthread_mutex_lock(&par_entry);
+  if (!started) {
+    par_topology();
+    for (int w = 0; w < par_threads(); w++) {
+      pthread_t t;
+      int e = pthread_create(&t, NULL, par_worker, (void *) (intptr_t) w);
+      if (e) eprintf("Could not start a worker thread: %s\n", strerror(e));
+      pthread_detach(t);
+    }
+    started = 1;
+  }
+  pthread_mutex_lock(&par_lock);
+  par_job = fn;  par_arg = arg;  par_n = n;
+  par_left = par_nthreads;  par_gen++;
+  pthread_cond_broadcast(&par_wake);
+  while (par_left) pthread_cond_wait(&par_done, &par_lock);
+  pthread_mutex_unlock(&par_lock);
+  pthread_mutex_unlock(&par_entry);
+}
+#else
+static int par_threads(void) { return 1; }
+static void par_loop(int n, par_fn fn, void * arg) {
+  for (int i = 0; i < n; i++) fn(arg, i);
+}
+#endif
+static _Thread_local int par_alone;
+static void par_run(int n, par_fn fn, void * arg) {
+  if (n == 1 || par_alone) for (int i = 0; i < n; i++) fn(arg, i);
+  else par_loop(n, fn, arg);
+}
+// bg_run(fn, arg) runs fn(arg) on a detached thread of the lowest
+// priority and returns at once. par_run calls made from that thread stay
+// on it, leaving the pool to the foreground. Without -DPTHREADS, fn runs
+// on the calling thread before bg_run returns.
+#if defined(PTHREADS)
+typedef struct { void (*fn)(void *); void * arg; int idle; } bg_job_t;
+static void * bg_main(void * p) {
+  bg_job_t job = *(bg_job_t *) p;
+  free(p);  par_alone = job.idle;
+#if defined(__linux__)
+  struct sched_param sp = { 0 };
+  if (job.idle) pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp);
+#endif
+  job.fn(job.arg);
+  scratch_free();
+  return NULL;
+}
+static void bg_start(void (*fn)(void *), void * arg, int idle) {
+  bg_job_t * job = malloc(sizeof(bg_job_t));
+  if (!job) eprintf("Out of memory.\n");
+  *job = (bg_job_t) { fn, arg, idle };
+  pthread_t t;
+  int e = pthread_create(&t, NULL, bg_main, job);
+  if (e) eprintf("Could not start a background thread: %s\n", strerror(e));
+  pthread_detach(t);
+}
+static void bg_run(void (*fn)(void *), void * arg) { bg_start(fn, arg, 1); }
+#else
+static void bg_run(void (*fn)(void *), void * arg) { fn(arg); }
 #endif
 
 // ---------------------------------------------------------------------------
-//      Low-level, preliminary primality test (fixed size sieve).
-//      Pre-generates primes via the Sieve of Atkin.
-//      Assumes that inputs to the algorithm `p' are p <= 2^(N_BITS - 1).
-//      and further p mod 4 = 3. Also uses Fermat's little theorem.
+//      Small primes for trial division, pre-generated via the Sieve of
+//      Atkin. Shared by the primality tests of all modulus sizes.
 // ---------------------------------------------------------------------------
 #define NPRIMES 4096
 static unsigned primes[NPRIMES];
-static bbs2int barrett_cache[NPRIMES];
-static void populate_barrett_cache(void) {
+static void sieve_primes(void) {
+  if (primes[0]) return;
   int limit = NPRIMES * log2(NPRIMES) * 1.2;
   if (limit < 2) limit = 2;
   char * p = calloc(limit + 1, 1);
@@ -109,267 +597,1632 @@ static void populate_barrett_cache(void) {
   for (int i = 2; i <= limit && count < NPRIMES; i++)
     if (p[i]) primes[count++] = i;
   free(p);
-  for (unsigned i = 0; i < NPRIMES; i++)
-    barrett_cache[i] = ((bbs2int) -1) / primes[i] + 1;
 }
-static bbsint modexp_half(bbsint base, bbsint e, bbsint mod) {
-  bbsint r = 1;
-  while (e) {
-    if (e & 1)
-      r = r * base % mod;
-    base = base * base % mod;
-    e >>= 1;
+
+// ---------------------------------------------------------------------------
+//      Multi-precision kernels. Plain _BitInt arithmetic compiles to
+//      whatever the build target allows, so portable binaries never use
+//      MULX/ADX or AVX-512 IFMA. The squarings and multiplications of the
+//      generator therefore go through limb kernels picked at startup by
+//      CPUID: portable 64-bit, MULX with dual ADCX/ADOX carry chains, and
+//      AVX-512 IFMA in radix 2^52. Operands are little-endian arrays of
+//      `n' 64-bit limbs - the in-memory layout of _BitInt on x86-64.
+// ---------------------------------------------------------------------------
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+  #error "The limb kernels assume a little-endian _BitInt layout."
+#endif
+typedef uint64_t limb_t;
+typedef unsigned _BitInt(128) dlimb_t;
+typedef struct {
+  const char * name;
+  void (*mul)(limb_t * r, const limb_t * a, const limb_t * b, int n,
+              scratch_t * sc);
+  void (*sqr)(limb_t * r, const limb_t * a, int n, scratch_t * sc);
+  int toom;         // Operand limbs from which Toom-3 wins.
+} kern_t;
+
+// Conversions between limbs and `bits'-bit digits.
+static void to_radix(uint64_t * d, int nd, const limb_t * a, int n,
+                     int bits) {
+  for (int i = 0; i < nd; i++) {
+    int bit = i * bits, w = bit / 64, s = bit % 64;
+    uint64_t v = w < n ? a[w] >> s : 0;
+    if (s > 64 - bits && w + 1 < n) v |= a[w + 1] << (64 - s);
+    d[i] = v & (((uint64_t) 1 << bits) - 1);
   }
-  return r;
 }
-static int p_low(bbsint n) {
-  for (unsigned i = 0; i < NPRIMES; i++)
-    if (barrett_cache[i] * n < barrett_cache[i]) return 0;
-  return modexp_half(2, n - 1, n) == 1; // Fermat.
+static void from_radix(limb_t * r, int n, const uint64_t * d, int nd,
+                       int bits) {
+  dlimb_t acc = 0;  int have = 0, w = 0;
+  for (int i = 0; i < nd && w < n; i++) {
+    acc |= (dlimb_t) d[i] << have;  have += bits;
+    if (have >= 64) { r[w++] = acc;  acc >>= 64;  have -= 64; }
+  }
+  while (w < n) { r[w++] = acc;  acc >>= 64; }
 }
 
-// ---------------------------------------------------------------------------
-//      High-level probabilistic primality test (Miller-Rabin).
-//      Assumptions are the same as for the low-level test.
-//      Uses binary exponentiation with Barrett reductions for speed.
-// ---------------------------------------------------------------------------
-static int ilog2(bbsint n) { int l = 0; while (n >>= 1) l++; return l; }
-static bbsint csrand(bbsint max, int ilog) {
-  for (;;) {
-    bbsint r; secrandom(&r, N_BITS / 8);
-    if ((r >>= N_BITS - ilog) < max) return r;
-  }
-}
-static int p_high(bbsint n, int iter) {
-  int s = 0;  bbsint d = n - 1;
-  while ((d & 1) == 0) { d >>= 1; s++; }
-  int ilog = ilog2(n - 3);
-  for (int i = 0; i < iter; i++) {
-    bbsint a = 2 + csrand(n - 3, ilog);
-    bbsint x = modexp_half(a, d, n);
-    if (x == 1 || x == n - 1)
-      continue;
-    int c = 0;
-    for (int r = 1; r < s; r++) {
-      x = x * x % n;
-      if (x == n - 1) { c = 1; break; }
+static void mul_generic(limb_t * r, const limb_t * a, const limb_t * b,
+                        int n, scratch_t * sc) {
+  (void) sc;
+  memset(r, 0, n * sizeof(limb_t));
+  for (int i = 0; i < n; i++) {
+    limb_t c = 0;
+    for (int j = 0; j < n; j++) {
+      dlimb_t t = (dlimb_t) a[i] * b[j] + r[i + j] + c;
+      r[i + j] = t;  c = t >> 64;
     }
-    if(!c) return 0;
+    r[i + n] = c;
   }
-  return 1;
 }
+// Squares: off-diagonal products once, then doubled with the diagonal added.
+static void sqr_diag(limb_t * r, const limb_t * a, int n) {
+  limb_t hi = 0;  dlimb_t c = 0;
+  for (int i = 0; i < 2 * n; i++) {
+    limb_t v = r[i];  r[i] = v << 1 | hi;  hi = v >> 63;
+  }
+  for (int i = 0; i < n; i++) {
+    dlimb_t d = (dlimb_t) a[i] * a[i];
+    c += (dlimb_t) r[2 * i] + (limb_t) d;  r[2 * i] = c;  c >>= 64;
+    c += (dlimb_t) r[2 * i + 1] + (limb_t) (d >> 64);
+    r[2 * i + 1] = c;  c >>= 64;
+  }
+}
+static void sqr_generic(limb_t * r, const limb_t * a, int n,
+                        scratch_t * sc) {
+  (void) sc;
+  memset(r, 0, 2 * n * sizeof(limb_t));
+  for (int i = 0; i < n - 1; i++) {
+    limb_t c = 0;
+    for (int j = i + 1; j < n; j++) {
+      dlimb_t t = (dlimb_t) a[i] * a[j] + r[i + j] + c;
+      r[i + j] = t;  c = t >> 64;
+    }
+    r[i + n] = c;
+  }
+  sqr_diag(r, a, n);
+}
+static const kern_t kern_generic = {
+  "generic", mul_generic, sqr_generic, 64
+};
 
-// ---------------------------------------------------------------------------
-//      Prime number generation for the BBS algorithm. Resulting p, q are
-//      Sophie Germain-safe primes.
-//      Yields correct results in 99.99999999999999999999999999999999997%
-//      of the cases (2^-128 error rate due to ROUNDS = 64 in Miller-Rabin).
-//      `gcd((p-3)/2, (q-3)/2)' should be small for maximised
-//      period length. Not strictly necessary; nmplemented here.
-//      Per Bertrand postulate we always find a suitable prime.
-//      
-//      Optimisation:
-//      We know that k = (p - 1)/2 (so p = 2k + 1) is prime. Then
-//      2^(p - 1) = 1 (mod p) implies that p is prime as well.
-// ---------------------------------------------------------------------------
-#ifndef OPENMP
-  static void generate_primes(bbsint * p1, bbsint * p2) {
-    bbsint p, q, r;  const int ROUNDS = 64;
-    do {
-      p = csrand((((bbsint) 1) << (N_BITS / 2 - 2)), N_BITS / 2 - 2);
-      p |= 0b11; r = 2 * p + 1;
-    } while (!p_low(r) || !p_high(r, ROUNDS)
-          || modexp_half(2, r - 1, r) != 1);
-    do {
-      q = csrand((((bbsint) 1) << (N_BITS / 2 - 2)), N_BITS / 2 - 2);
-      q |= 0b11; r = 2 * q + 1;
-    } while (p == q || !p_low(r) || !p_high(r, ROUNDS)
-           || modexp_half(2, r - 1, r) != 1);
-    *p1 = 2 * p + 1; *p2 = 2 * q + 1;
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+// r[0..n) += a[0..n) * b, returning the carry limb. The loops keep the
+// carry of the low halves in CF (ADCX) and of the high halves in OF (ADOX);
+// LEA and JRCXZ leave both untouched. n % 4 limbs are handled one at
+// a time first, the rest four at a time.
+#define ADX_STEP(k, from, to)                                                \
+  "mulx " #k "(%[a]), %[lo], %[" #to "]\n\t"                                 \
+  "adcx " #k "(%[r]), %[lo]\n\t"                                             \
+  "adox %[" #from "], %[lo]\n\t"                                             \
+  "movq %[lo], " #k "(%[r])\n\t"
+static limb_t addmul_1_adx(limb_t * r, const limb_t * a, int n, limb_t b) {
+  limb_t lo, h = 0, c = 0;  unsigned long cnt = n & 3, blocks = n >> 2;
+  __asm__ volatile(
+    "xorl %k[lo], %k[lo]\n\t"
+    "jrcxz 3f\n"
+    "1:\n\t"
+    ADX_STEP(0, c, h)
+    "movq %[h], %[c]\n\t"
+    "leaq 8(%[a]), %[a]\n\t"
+    "leaq 8(%[r]), %[r]\n\t"
+    "leaq -1(%[cnt]), %[cnt]\n\t"
+    "jrcxz 3f\n\t"
+    "jmp 1b\n"
+    "3:\n\t"
+    "movq %[blocks], %[cnt]\n\t"
+    "jrcxz 5f\n"
+    "4:\n\t"
+    ADX_STEP(0, c, h) ADX_STEP(8, h, c) ADX_STEP(16, c, h) ADX_STEP(24, h, c)
+    "leaq 32(%[a]), %[a]\n\t"
+    "leaq 32(%[r]), %[r]\n\t"
+    "leaq -1(%[cnt]), %[cnt]\n\t"
+    "jrcxz 5f\n\t"
+    "jmp 4b\n"
+    "5:\n\t"
+    "movl $0, %k[lo]\n\t"
+    "adcx %[lo], %[c]\n\t"
+    "adox %[lo], %[c]\n"
+    : [lo] "=&r" (lo), [h] "+&r" (h), [c] "+&r" (c),
+      [a] "+&r" (a), [r] "+&r" (r), [cnt] "+&c" (cnt)
+    : "d" (b), [blocks] "r" (blocks)
+    : "cc", "memory");
+  return c;
+}
+static void mul_adx(limb_t * r, const limb_t * a, const limb_t * b, int n,
+                    scratch_t * sc) {
+  (void) sc;
+  memset(r, 0, n * sizeof(limb_t));
+  for (int i = 0; i < n; i++)
+    r[i + n] = addmul_1_adx(r + i, a, n, b[i]);
+}
+static void sqr_adx(limb_t * r, const limb_t * a, int n, scratch_t * sc) {
+  (void) sc;
+  memset(r, 0, 2 * n * sizeof(limb_t));
+  for (int i = 0; i < n - 1; i++)
+    r[i + n] = addmul_1_adx(r + 2 * i + 1, a + i + 1, n - i - 1, a[i]);
+  sqr_diag(r, a, n);
+}
+static const kern_t kern_adx = { "adx", mul_adx, sqr_adx, 112 };
+
+// AVX-512 IFMA works on 52-bit digits. Each digit of `a' is broadcast
+// against eight digits of `b' at a time; the low and high halves of the
+// 104-bit products are summed into separate columns without carrying
+// (a column collects at most `n52' terms below 2^52), and carries are
+// resolved once at the end. The digits and columns live in the arena.
+#define IFMA __attribute__((target("avx512f,avx512ifma")))
+IFMA static void mul_ifma(limb_t * r, const limb_t * a, const limb_t * b,
+                          int n, scratch_t * sc) {
+  int n52 = (n * 64 + 51) / 52, nb = (n52 + 7) & ~7;
+  size_t mark = sc->used;
+  uint64_t * a52 = scratch_push(sc, (3 * n52 + 3 * nb) * sizeof(uint64_t));
+  uint64_t * b52 = a52 + n52, * lo = b52 + nb, * hi = lo + n52 + nb;
+  to_radix(a52, n52, a, n, 52);  to_radix(b52, nb, b, n, 52);
+  memset(lo, 0, (n52 + nb) * sizeof(uint64_t));
+  memset(hi, 0, (n52 + nb) * sizeof(uint64_t));
+  for (int i = 0; i < n52; i++) {
+    __m512i x = _mm512_set1_epi64(a52[i]);
+    for (int j = 0; j < nb; j += 8) {
+      __m512i y = _mm512_loadu_si512(b52 + j);
+      __m512i l = _mm512_loadu_si512(lo + i + j);
+      __m512i h = _mm512_loadu_si512(hi + i + j);
+      _mm512_storeu_si512(lo + i + j, _mm512_madd52lo_epu64(l, x, y));
+      _mm512_storeu_si512(hi + i + j, _mm512_madd52hi_epu64(h, x, y));
+    }
   }
-#else
-  static void generate_primes(bbsint * p1, bbsint * p2) {
-    const int ROUNDS = 64;  _Atomic(int) found;
-    found = 0;
-    #pragma omp parallel for
-    for (int i = 0; i < omp_get_num_threads(); i++) {
-      bbsint p, r;
-      do {
-        p = csrand((((bbsint) 1) << (N_BITS / 2 - 2)), N_BITS / 2 - 2);
-        p |= 0b11; r = 2 * p + 1;
-      } while (!found && (!p_low(r) || !p_high(r, ROUNDS)
-            || modexp_half(2, r - 1, r) != 1));
-      #pragma omp critical
-      { if (!found) *p1 = 2 * p + 1, found = 1; }
+  uint64_t c = 0;
+  for (int k = 0; k < 2 * n52; k++) {
+    uint64_t t = lo[k] + (k ? hi[k - 1] : 0) + c;
+    lo[k] = t & 0xFFFFFFFFFFFFF;  c = t >> 52;
+  }
+  from_radix(r, 2 * n, lo, 2 * n52, 52);
+  sc->used = mark;
+}
+// Squares sum the products above the diagonal only; the columns are
+// then doubled and the diagonal is added.
+IFMA static void sqr_ifma(limb_t * r, const limb_t * a, int n,
+                          scratch_t * sc) {
+  int n52 = (n * 64 + 51) / 52, nb = (n52 + 8) & ~7;
+  size_t mark = sc->used;
+  uint64_t * a52 = scratch_push(sc, (5 * nb + 24) * sizeof(uint64_t));
+  uint64_t * lo = a52 + nb + 8, * hi = lo + 2 * nb + 8;
+  to_radix(a52, nb + 8, a, n, 52);
+  memset(lo, 0, (2 * nb + 8) * sizeof(uint64_t));
+  memset(hi, 0, (2 * nb + 8) * sizeof(uint64_t));
+  for (int i = 0; i < n52 - 1; i++) {
+    __m512i x = _mm512_set1_epi64(a52[i]);
+    for (int j = i + 1; j < n52; j += 8) {
+      __m512i y = _mm512_loadu_si512(a52 + j);
+      __m512i l = _mm512_loadu_si512(lo + i + j);
+      __m512i h = _mm512_loadu_si512(hi + i + j);
+      _mm512_storeu_si512(lo + i + j, _mm512_madd52lo_epu64(l, x, y));
+      _mm512_storeu_si512(hi + i + j, _mm512_madd52hi_epu64(h, x, y));
     }
-    found = 0;
-    #pragma omp parallel for
-    for (int i = 0; i < omp_get_num_threads(); i++) {
-      bbsint q, p = *p1, r;
-      do {
-        q = csrand((((bbsint) 1) << (N_BITS / 2 - 2)) - N_BITS, N_BITS / 2 - 2);
-        q |= 0b11; r = 2 * q + 1;
-      } while (!found && (!p_low(r) || !p_high(r, ROUNDS)
-            || modexp_half(2, r - 1, r) != 1 || 2 * q + 1 == p));
-      #pragma omp critical
-      { if (!found) *p2 = 2 * q + 1, found = 1; }
+  }
+  for (int k = 0; k < 2 * n52; k += 8) {
+    __m512i l = _mm512_loadu_si512(lo + k), h = _mm512_loadu_si512(hi + k);
+    _mm512_storeu_si512(lo + k, _mm512_add_epi64(l, l));
+    _mm512_storeu_si512(hi + k, _mm512_add_epi64(h, h));
+  }
+  for (int i = 0; i < n52; i += 8) {
+    __m512i x = _mm512_loadu_si512(a52 + i), z = _mm512_setzero_si512();
+    __m512i l = _mm512_madd52lo_epu64(z, x, x);
+    __m512i h = _mm512_madd52hi_epu64(z, x, x);
+    for (int k = 0; k < 8 && i + k < n52; k++) {
+      lo[2 * (i + k)] += l[k];  hi[2 * (i + k)] += h[k];
     }
   }
+  uint64_t c = 0;
+  for (int k = 0; k < 2 * n52; k++) {
+    uint64_t t = lo[k] + (k ? hi[k - 1] : 0) + c;
+    lo[k] = t & 0xFFFFFFFFFFFFF;  c = t >> 52;
+  }
+  from_radix(r, 2 * n, lo, 2 * n52, 52);
+  sc->used = mark;
+}
+static const kern_t kern_ifma = { "ifma", mul_ifma, sqr_ifma, 640 };
+#endif
+
+// The kernel of the run, or NULL for libcbbs to pick one per product
+// from kern_auto: contexts of several sizes may be in use at once, so
+// the operand size stands in for the modulus size.
+static const kern_t * kern = &kern_generic;
+static const kern_t * kern_auto[2];  // Below and from 64 limbs.
+#ifdef HAVE_X86_KERNELS
+static int cpu_has(const char * feature) {
+  unsigned a, b, c, d, b7, xcr0 = 0;
+  if (!__get_cpuid_count(7, 0, &a, &b7, &c, &d)) return 0;
+  if (__get_cpuid(1, &a, &b, &c, &d) && (c >> 27 & 1)) // OSXSAVE
+    __asm__("xgetbv" : "=a" (xcr0), "=d" (d) : "c" (0));
+  int avx = (xcr0 & 0x6) == 0x6, avx512 = (xcr0 & 0xE6) == 0xE6;
+  if (!strcmp(feature, "adx")) return (b7 >> 8 & 1) && (b7 >> 19 & 1);
+  if (!strcmp(feature, "avx2")) return avx && (b7 >> 5 & 1);
+  if (!strcmp(feature, "avx512f")) return avx512 && (b7 >> 16 & 1);
+  if (!strcmp(feature, "ifma"))
+    return avx512 && (b7 >> 16 & 1) && (b7 >> 21 & 1);
+  return 0;
+}
+#endif
+static const kern_t * find_kernel(const char * name) {
+  if (!strcmp(name, kern_generic.name)) return &kern_generic;
+#ifdef HAVE_X86_KERNELS
+  if (!strcmp(name, "ifma") && cpu_has("ifma")) return &kern_ifma;
+  if (!strcmp(name, "adx") && cpu_has("adx")) return &kern_adx;
 #endif
+  return NULL;
+}
+static const kern_t * best_kernel(int bits) {
+  const kern_t * k;
+  // IFMA pays for the radix conversions only on large operands.
+  if (bits >= 4096 && (k = find_kernel("ifma"))) return k;
+  if ((k = find_kernel("adx"))) return k;
+  return &kern_generic;
+}
+static void select_kernel(const char * name, int bits) {
+  if (name) {
+    if (!(kern = find_kernel(name)))
+      eprintf("Kernel `%s' is not supported on this machine.\n", name);
+    return;
+  }
+  kern = best_kernel(bits);
+}
+// r = a - b over n limbs, returning the borrow.
+static limb_t sub_n(limb_t * r, const limb_t * a, const limb_t * b, int n) {
+  limb_t borrow = 0;
+  for (int i = 0; i < n; i++) {
+    limb_t d = a[i] - b[i] - borrow;
+    borrow = a[i] < b[i] || (a[i] == b[i] && borrow);
+    r[i] = d;
+  }
+  return borrow;
+}
+// r = a + b over n limbs, returning the carry.
+static limb_t add_n(limb_t * r, const limb_t * a, const limb_t * b, int n) {
+  limb_t carry = 0;
+  for (int i = 0; i < n; i++) {
+    limb_t s = a[i] + carry;
+    carry = s < carry;  r[i] = s + b[i];  carry += r[i] < s;
+  }
+  return carry;
+}
+// r[0..n) += a[0..m) for m <= n; the carry out of r is dropped.
+static void add_to(limb_t * r, int n, const limb_t * a, int m) {
+  limb_t carry = add_n(r, r, a, m);
+  for (int i = m; carry && i < n; i++) carry = !++r[i];
+}
 
 // ---------------------------------------------------------------------------
-//      Greatest common divisor via Stein's algorithm.
+//      Products of large operands, for moduli beyond 8192 bits. From
+//      the toom limbs of the kernel, Toom-3 splits operands into thirds
+//      and recurses on five products of a third of the size. mul_n(r, a,
+//      b, n, sc) picks the kernel and method for n limbs, and squares
+//      when a == b; both take their temporaries from the arena sc.
+//      Number-theoretic transforms were measured as well: up to 1025
+//      limbs, the largest products of 65536-bit moduli, they are at best
+//      even with Toom-3.
 // ---------------------------------------------------------------------------
-int ctz(bbsint n) {
-  int c = 0; while ((n & 1) == 0 && n != 0) { n >>= 1; c++; } return c;
+static void mul_n(limb_t * r, const limb_t * a, const limb_t * b, int n,
+                  scratch_t * sc);
+
+// Toom-3 with evaluation at 0, 1, -1, 2 and infinity and the
+// interpolation sequence of Bodrato and Zanoni. x0 + x1 X + x2 X^2 with
+// X = b^s is evaluated into s + 1 limbs; the sign of x(-1) is returned.
+static int toom_eval(limb_t * e1, limb_t * em, limb_t * e2, const limb_t * x,
+                     int s, int h, scratch_t * sc) {
+  size_t mark = sc->used;
+  limb_t * t = scratch_push(sc, 2 * (s + 1) * sizeof(limb_t));
+  limb_t * x1 = t + s + 1;
+  memcpy(x1, x + s, s * sizeof(limb_t));  x1[s] = 0;
+  memcpy(t, x, s * sizeof(limb_t));  t[s] = 0;
+  add_to(t, s + 1, x + 2 * s, h);                 // x0 + x2
+  add_n(e1, t, x1, s + 1);
+  int neg = sub_n(em, t, x1, s + 1) != 0;
+  if (neg) sub_n(em, x1, t, s + 1);
+  memset(e2, 0, (s + 1) * sizeof(limb_t));        // (2 x2 + x1) 2 + x0
+  memcpy(e2, x + 2 * s, h * sizeof(limb_t));
+  add_n(e2, e2, e2, s + 1);  add_n(e2, e2, x1, s + 1);
+  add_n(e2, e2, e2, s + 1);  add_to(e2, s + 1, x, s);
+  sc->used = mark;
+  return neg;
+}
+// x = x / 3 over n limbs, for x divisible by 3 (Hensel division).
+static void divexact_3(limb_t * x, int n) {
+  limb_t c = 0;
+  for (int i = 0; i < n; i++) {
+    limb_t b = x[i] < c, q = (x[i] - c) * 0xAAAAAAAAAAAAAAAB;
+    x[i] = q;  c = (limb_t) ((dlimb_t) q * 3 >> 64) + b;
+  }
+}
+static void rshift_1(limb_t * x, int n) {
+  for (int i = 0; i < n - 1; i++) x[i] = x[i] >> 1 | x[i + 1] << 63;
+  x[n - 1] >>= 1;
 }
-bbsint gcd(bbsint a, bbsint b) {
-  if (!a) return b; if (!b) return a;
-  int az = ctz(a), bz = ctz(b);
-  int shift = az < bz ? az : bz;
-  b >>= bz;
-  while (a != 0) {
-    a >>= az;
-    bbsint diff = b - a;
-    az = ctz(diff);
-    b = a < b ? a : b;
-    a = diff & ((bbsint) 1 << (N_BITS - 1)) ? 1 + ~diff : diff;
-    if (a == b) return a;
+static void toom3(limb_t * r, const limb_t * a, const limb_t * b, int n,
+                  scratch_t * sc) {
+  int s = (n + 2) / 3, h = n - 2 * s, w = 2 * s + 2;
+  size_t mark = sc->used;
+  limb_t * ea1 = scratch_push(sc, 7 * w * sizeof(limb_t));
+  limb_t * eam = ea1 + s + 1, * ea2 = eam + s + 1;
+  limb_t * eb1 = ea2 + s + 1, * ebm = eb1 + s + 1, * eb2 = ebm + s + 1;
+  limb_t * v1 = eb2 + s + 1, * vm = v1 + w, * v2 = vm + w, * t = v2 + w;
+  int neg = toom_eval(ea1, eam, ea2, a, s, h, sc);
+  if (a == b) {
+    neg = 0;
+    mul_n(v1, ea1, ea1, s + 1, sc);  mul_n(vm, eam, eam, s + 1, sc);
+    mul_n(v2, ea2, ea2, s + 1, sc);
+  } else {
+    neg ^= toom_eval(eb1, ebm, eb2, b, s, h, sc);
+    mul_n(v1, ea1, eb1, s + 1, sc);  mul_n(vm, eam, ebm, s + 1, sc);
+    mul_n(v2, ea2, eb2, s + 1, sc);
   }
-  return b << shift;
+  memset(r + 2 * s, 0, 2 * s * sizeof(limb_t));
+  mul_n(r, a, b, s, sc);                          // v0 = c0
+  mul_n(r + 4 * s, a + 2 * s, b + 2 * s, h, sc);  // vinf = c4
+  // Every step leaves a non-negative value below 2^(64 w).
+  if (neg) {
+    add_n(v2, v2, vm, w);  add_n(vm, v1, vm, w);
+  } else {
+    sub_n(v2, v2, vm, w);  sub_n(vm, v1, vm, w);
+  }
+  divexact_3(v2, w);                              // c1 + c2 + 3 c3 + 5 c4
+  rshift_1(vm, w);                                // c1 + c3
+  memset(t, 0, w * sizeof(limb_t));  memcpy(t, r, 2 * s * sizeof(limb_t));
+  sub_n(v1, v1, t, w);                            // c1 + c2 + c3 + c4
+  sub_n(v2, v2, v1, w);  rshift_1(v2, w);         // c3 + 2 c4
+  memset(t, 0, w * sizeof(limb_t));
+  memcpy(t, r + 4 * s, 2 * h * sizeof(limb_t));
+  sub_n(v1, v1, vm, w);  sub_n(v1, v1, t, w);     // c2
+  sub_n(v2, v2, t, w);  sub_n(v2, v2, t, w);      // c3
+  sub_n(vm, vm, v2, w);                           // c1
+  // Each c_i X^i < b^2n, so limbs of c_i beyond 2n are zero.
+  for (int i = 1; i <= 3; i++) {
+    const limb_t * c = i == 1 ? vm : i == 2 ? v1 : v2;
+    int len = 2 * n - i * s;
+    add_to(r + i * s, len, c, w < len ? w : len);
+  }
+  sc->used = mark;
+}
+
+static void mul_n(limb_t * r, const limb_t * a, const limb_t * b, int n,
+                  scratch_t * sc) {
+  const kern_t * k = kern ? kern : kern_auto[n >= 4096 / 64];
+  if (n >= k->toom) toom3(r, a, b, n, sc);
+  else if (a == b) k->sqr(r, a, n, sc);
+  else k->mul(r, a, b, n, sc);
 }
 
 // ---------------------------------------------------------------------------
-//      Interface to the Blum Blum Shub generator.
+//      Greatest common divisors and modular inverses of multi-limb numbers,
+//      by Pornin's optimised binary GCD. Steps of the binary algorithm are
+//      decided on 64-bit approximations of the operands (their low 31 and
+//      top 33 bits) and recorded as a 2x2 matrix, which is applied to the
+//      full operands once every 31 steps. A round thus costs two linear
+//      combinations instead of 31 passes of shifts and subtractions, and
+//      powers of two are found with the ctz instruction.
 // ---------------------------------------------------------------------------
-typedef struct { bbsint pq, x, x0, c; int pos; } bbs_t;
-static void bbs_new(bbs_t * bbs) {
-  bbsint p, q;  generate_primes(&p, &q);
-  bbs->pq = p * q;
+typedef _BitInt(128) sdlimb_t;
+static int ctz_n(const limb_t * a, int n) {  // 64 n if a = 0.
+  for (int i = 0; i < n; i++)
+    if (a[i]) return 64 * i + __builtin_ctzll(a[i]);
+  return 64 * n;
+}
+static int bitlen_n(const limb_t * a, int n) {
+  while (n && !a[n - 1]) n--;
+  return n ? 64 * n - __builtin_clzll(a[n - 1]) : 0;
+}
+// r = a >> s and r = a << s over n limbs, for s < 64 n; r may alias a.
+static void shr_n(limb_t * r, const limb_t * a, int s, int n) {
+  int w = s / 64, b = s % 64;
+  for (int i = 0; i < n; i++) {
+    limb_t lo = i + w < n ? a[i + w] : 0;
+    limb_t hi = i + w + 1 < n ? a[i + w + 1] : 0;
+    r[i] = b ? lo >> b | hi << (64 - b) : lo;
+  }
+}
+static void shl_n(limb_t * r, const limb_t * a, int s, int n) {
+  int w = s / 64, b = s % 64;
+  for (int i = n - 1; i >= 0; i--) {
+    limb_t hi = i - w >= 0 ? a[i - w] : 0;
+    limb_t lo = i - w - 1 >= 0 ? a[i - w - 1] : 0;
+    r[i] = b ? hi << b | lo >> (64 - b) : hi;
+  }
+}
+// r = a / d over n limbs, returning the remainder.
+static limb_t div_1(limb_t * r, const limb_t * a, limb_t d, int n) {
+  dlimb_t rem = 0;
+  for (int i = n - 1; i >= 0; i--) {
+    rem = rem << 64 | a[i];  r[i] = rem / d;  rem %= d;
+  }
+  return rem;
+}
+// |f a + g b| / 2^31 into r, using n + 1 limbs at t; returns 1 if
+// f a + g b < 0. The division is exact and the quotient fits in n limbs.
+static int gcd_comb(limb_t * r, const limb_t * a, const limb_t * b,
+                    int64_t f, int64_t g, int n, limb_t * t) {
+  sdlimb_t acc = 0;
+  for (int i = 0; i < n; i++) {
+    acc += (sdlimb_t) f * a[i] + (sdlimb_t) g * b[i];
+    t[i] = (limb_t) acc;  acc >>= 64;
+  }
+  t[n] = (limb_t) acc;
+  int neg = (int64_t) t[n] < 0;
+  for (int i = 0, c = 1; neg && i <= n; i++) {
+    t[i] = ~t[i] + c;  c = c && !t[i];
+  }
+  for (int i = 0; i < n; i++) r[i] = t[i] >> 31 | t[i + 1] << 33;
+  return neg;
+}
+// (f u + g v) / 2^31 mod m into r, for u, v < m, m odd and
+// minv = -m^-1 mod 2^64, using n + 1 limbs at t. A multiple of m clears
+// the low 31 bits first.
+static void gcd_comb_mod(limb_t * r, const limb_t * u, const limb_t * v,
+                         int64_t f, int64_t g, const limb_t * m,
+                         limb_t minv, int n, limb_t * t) {
+  sdlimb_t acc = 0;
+  limb_t k = ((limb_t) f * u[0] + (limb_t) g * v[0]) * minv & 0x7FFFFFFF;
+  for (int i = 0; i < n; i++) {
+    acc += (sdlimb_t) f * u[i] + (sdlimb_t) g * v[i] + (sdlimb_t) k * m[i];
+    t[i] = (limb_t) acc;  acc >>= 64;
+  }
+  t[n] = (limb_t) acc;
+  for (int i = 0; i < n; i++) r[i] = t[i] >> 31 | t[i + 1] << 33;
+  int64_t top = (int64_t) t[n] >> 31;  // The result lies in (-m, 2m).
+  while (top < 0) top += add_n(r, r, m, n);
+  if (sub_n(t, r, m, n) <= (limb_t) top) memcpy(r, t, n * sizeof(limb_t));
+}
+// Runs the binary GCD on a and odd b until a = 0, leaving gcd(a, b) in
+// b. With u != NULL, u and v follow a = u y and b = v y mod the odd m,
+// for whatever y the caller started them from.
+static void gcd_run(limb_t * a, limb_t * b, limb_t * u, limb_t * v,
+                    const limb_t * m, int n, scratch_t * sc) {
+  size_t mark = sc->used;
+  limb_t * ta = scratch_push(sc, (3 * n + 1) * sizeof(limb_t));
+  limb_t * tb = ta + n, * w = tb + n, minv = 0;
+  if (u) {
+    minv = m[0];
+    for (int i = 0; i < 5; i++) minv *= 2 - m[0] * minv;
+    minv = -minv;
+  }
   for (;;) {
-    bbs->x = csrand(bbs->pq, ilog2(bbs->pq));
-    if (bbs->x <= 1) continue;
-    if (bbs->x % p != 0 && bbs->x % q != 0) break;
-  }
-  bbs->x0 = bbs->x;
-  bbs->c = (p - 1) * (q - 1) / gcd(p - 1, q - 1);
-  bbs->pos = 0;
-}
-static void bbs_step(bbs_t * bbs) {
-  bbs2int sq = ((bbs2int) bbs->x) * bbs->x;
-  bbs->x = sq % bbs->pq;
-  bbs->pos++;
-}
-static bbsint modexp(bbsint base, bbsint e, bbsint mod) {
-  bbsint r = 1;
-  while (e) {
-    if (e & 1)
-      r = (((bbs2int) r) * base) % mod;
-    base = (((bbs2int) base) * base) % mod;
-    e >>= 1;
+    int la = bitlen_n(a, n), lb = bitlen_n(b, n), len = la > lb ? la : lb;
+    int k = (len + 63) / 64;  // Only the low k limbs can be nonzero.
+    if (!la) { sc->used = mark;  return; }
+    uint64_t xa = a[0], xb = b[0];
+    if (len > 64) {
+      int w = (len - 33) / 64, s = (len - 33) % 64;
+      uint64_t ha = a[w] >> s, hb = b[w] >> s;
+      if (s > 31) ha |= a[w + 1] << (64 - s), hb |= b[w + 1] << (64 - s);
+      xa = (xa & 0x7FFFFFFF) | ha << 31;
+      xb = (xb & 0x7FFFFFFF) | hb << 31;
+    }
+    int64_t f0 = 1, g0 = 0, f1 = 0, g1 = 1, t;
+    for (int j = 0; j < 31; j++) {
+      if (xa & 1) {
+        if (xa < xb) {
+          uint64_t x = xa;  xa = xb;  xb = x;
+          t = f0;  f0 = f1;  f1 = t;  t = g0;  g0 = g1;  g1 = t;
+        }
+        xa -= xb;  f0 -= f1;  g0 -= g1;
+      }
+      xa >>= 1;  f1 *= 2;  g1 *= 2;
+    }
+    if (gcd_comb(ta, a, b, f0, g0, k, w)) f0 = -f0, g0 = -g0;
+    if (gcd_comb(tb, a, b, f1, g1, k, w)) f1 = -f1, g1 = -g1;
+    memcpy(a, ta, k * sizeof(limb_t));  memcpy(b, tb, k * sizeof(limb_t));
+    if (!u) continue;
+    gcd_comb_mod(ta, u, v, f0, g0, m, minv, n, w);
+    gcd_comb_mod(tb, u, v, f1, g1, m, minv, n, w);
+    memcpy(u, ta, n * sizeof(limb_t));  memcpy(v, tb, n * sizeof(limb_t));
   }
-  return r;
 }
-static void bbs_set(bbs_t * bbs, unsigned i) {
-  bbsint arg = modexp(2, i, bbs->c);
-  bbs->x = modexp(bbs->x0, arg, bbs->pq);
-  bbs->pos = i;
+// r = gcd(a, b) over n limbs.
+static void gcd_n(limb_t * r, const limb_t * a, const limb_t * b, int n,
+                  scratch_t * sc) {
+  int za = ctz_n(a, n), zb = ctz_n(b, n);
+  if (za == 64 * n || zb == 64 * n) {
+    memcpy(r, za == 64 * n ? b : a, n * sizeof(limb_t));
+    return;
+  }
+  size_t mark = sc->used;
+  limb_t * x = scratch_push(sc, 2 * n * sizeof(limb_t)), * y = x + n;
+  shr_n(x, a, za, n);  shr_n(y, b, zb, n);
+  gcd_run(x, y, NULL, NULL, NULL, n, sc);
+  shl_n(r, y, za < zb ? za : zb, n);
+  sc->used = mark;
+}
+// r = a^-1 mod m over n limbs, for odd m > 1 and a < m. Returns 0,
+// leaving r alone, if a is not invertible.
+static int inv_n(limb_t * r, const limb_t * a, const limb_t * m, int n,
+                 scratch_t * sc) {
+  size_t mark = sc->used;
+  limb_t * x = scratch_push(sc, 4 * n * sizeof(limb_t));
+  limb_t * y = x + n, * u = y + n, * v = u + n;
+  memcpy(x, a, n * sizeof(limb_t));  memcpy(y, m, n * sizeof(limb_t));
+  memset(u, 0, 2 * n * sizeof(limb_t));  u[0] = 1;
+  gcd_run(x, y, u, v, m, n, sc);
+  int ok = bitlen_n(y, n) == 1;
+  if (ok) memcpy(r, v, n * sizeof(limb_t));
+  sc->used = mark;
+  return ok;
 }
-static bbsint bbs_next(bbs_t * bbs, int bits) {
-  bbsint r = 0;
-  for (int i = bits; i != 0; --i) {
-    bbs_step(bbs); r = (r << 1) | (bbs->x & 1);
+// The product of the NPRIMES small primes. With `-t gcd', trial division
+// is a single GCD of the candidate with it (p_low_gcd in bbs-core.h).
+static int trial_gcd;
+static limb_t * primorial;
+static int primorial_n;
+static void populate_primorial(void) {
+  if (primorial) return;
+  sieve_primes();
+  primorial = malloc((NPRIMES / 4 + 1) * sizeof(limb_t));  // Primes < 2^16.
+  if (!primorial) eprintf("Out of memory.\n");
+  primorial[0] = 1;  primorial_n = 1;
+  for (int i = 0; i < NPRIMES; i++) {
+    limb_t carry = 0;
+    for (int j = 0; j < primorial_n; j++) {
+      dlimb_t t = (dlimb_t) primorial[j] * primes[i] + carry;
+      primorial[j] = t;  carry = t >> 64;
+    }
+    if (carry) primorial[primorial_n++] = carry;
   }
-  return r;
 }
-static uint64_t bbs_next64(bbs_t * bbs) {
-  uint64_t r = 0;
-  for (int i = 64; i != 0; --i) {
-    bbs_step(bbs); r = (r << 1) | (bbs->x & 1);
+
+// ---------------------------------------------------------------------------
+//      Vertical dot products for the multi-lane engine (bbs-core.h), which
+//      keeps LANES residues side by side in radix 2^26. AVX-512 handles
+//      8 lanes per vector, AVX2 4 lanes; there is a C version as well.
+// ---------------------------------------------------------------------------
+#define LANES 8
+#define LANE_BITS 26
+#define LANE_MASK ((1u << LANE_BITS) - 1)
+typedef uint64_t lane_t[LANES];
+// acc += a[i] * b[n - 1 - i] summed over i < n, lane by lane. All
+// inputs are below 2^32.
+static void lanes_dot_generic(uint64_t * acc, const lane_t * a,
+                              const lane_t * b, int n) {
+  for (int i = 0; i < n; i++)
+    for (int l = 0; l < LANES; l++)
+      acc[l] += a[i][l] * b[n - 1 - i][l];
+}
+#ifdef HAVE_X86_KERNELS
+__attribute__((target("avx512f")))
+static void lanes_dot_avx512(uint64_t * acc, const lane_t * a,
+                             const lane_t * b, int n) {
+  __m512i s = _mm512_loadu_si512(acc);
+  for (int i = 0; i < n; i++)
+    s = _mm512_add_epi64(s, _mm512_mul_epu32(_mm512_loadu_si512(a[i]),
+                                             _mm512_loadu_si512(b[n - 1 - i])));
+  _mm512_storeu_si512(acc, s);
+}
+__attribute__((target("avx2")))
+static void lanes_dot_avx2(uint64_t * acc, const lane_t * a,
+                           const lane_t * b, int n) {
+  __m256i s0 = _mm256_loadu_si256((const __m256i *) acc);
+  __m256i s1 = _mm256_loadu_si256((const __m256i *) (acc + 4));
+  for (int i = 0; i < n; i++) {
+    const __m256i * x = (const __m256i *) a[i];
+    const __m256i * y = (const __m256i *) b[n - 1 - i];
+    s0 = _mm256_add_epi64(s0, _mm256_mul_epu32(_mm256_loadu_si256(x),
+                                               _mm256_loadu_si256(y)));
+    s1 = _mm256_add_epi64(s1, _mm256_mul_epu32(_mm256_loadu_si256(x + 1),
+                                               _mm256_loadu_si256(y + 1)));
+  }
+  _mm256_storeu_si256((__m256i *) acc, s0);
+  _mm256_storeu_si256((__m256i *) (acc + 4), s1);
+}
+#endif
+static void (*lanes_dot)(uint64_t *, const lane_t *, const lane_t *, int)
+  = lanes_dot_generic;
+static void select_lanes(void) {
+#ifdef HAVE_X86_KERNELS
+  if (cpu_has("avx512f")) lanes_dot = lanes_dot_avx512;
+  else if (cpu_has("avx2")) lanes_dot = lanes_dot_avx2;
+#endif
+}
+// acc += (a . b) << twice, as lanes_dot, in runs of LANE_RUN products.
+// After each run, the bits of acc from 32 up move to hi, so that no
+// column overflows 64 bits however long it is; the caller adds hi back
+// once it has shifted acc down.
+#define LANE_RUN 1024
+static void lanes_dot_run(uint64_t * acc, uint64_t * hi, const lane_t * a,
+                          const lane_t * b, int n, int twice) {
+  for (int j = 0; j < n; j += LANE_RUN) {
+    int len = n - j < LANE_RUN ? n - j : LANE_RUN;
+    uint64_t d[LANES] = { 0 };
+    lanes_dot(d, a + j, b + n - j - len, len);
+    for (int l = 0; l < LANES; l++) {
+      acc[l] += d[l] << twice;
+      hi[l] += acc[l] >> 32;  acc[l] &= 0xFFFFFFFF;
+    }
   }
+}
+
+// ---------------------------------------------------------------------------
+//      Residue number system engine (experimental). The state is kept
+//      modulo 2k primes just below 2^62: base A, the first k, and base B,
+//      the next k. Squaring is RNS Montgomery multiplication: squares and
+//      quotients are computed channel by channel with no carries, and only
+//      the two base extensions mix channels - Bajard's approximate one from
+//      A to B, whose error of a few multiples of A the bounds absorb, and
+//      Kawamura's exact one from B to A, where the number of wraparounds
+//      is read off the top bits of the channel terms. The parity of the
+//      state comes from a fixed-point estimate of z / pq, with an exact
+//      fallback in bbs-core.h when it lands too close to an integer.
+//      The state x A mod pq lies below (k + 2) pq, and A, B > 2^61k.
+// ---------------------------------------------------------------------------
+#define RNS_K(bits) ((bits) / 61 + 2)  // Channels per base.
+#define RNS_KMAX RNS_K(MAX_BITS)
+// Moduli and the tables that depend only on them, shared by all moduli pq
+// of one size. a_i = m[i], b_j = m[k + j].
+typedef struct {
+  int k;
+  uint64_t m[2 * RNS_KMAX], minv[2 * RNS_KMAX];  // -m^-1 mod 2^64.
+  uint64_t r1[2 * RNS_KMAX], r2[2 * RNS_KMAX];    // 2^64, 2^128 mod m.
+  uint64_t * ab, * ba;           // A / a_i mod b_j at [j k + i], and back.
+  uint64_t ainv[RNS_KMAX];       // (A / a_i)^-1 mod a_i.
+  uint64_t binv[RNS_KMAX];       // (B / b_j)^-1 mod b_j.
+  uint64_t amodb[RNS_KMAX];      // A mod b_j.
+  uint64_t bmoda[RNS_KMAX];      // B 2^64 mod a_i.
+  uint64_t e[RNS_KMAX], e0;      // B / b_j and B, mod 2^64.
+  uint64_t off;                  // Sum of 2^62 - b_j, plus one.
+  limb_t a[RNS_KMAX + 1], b[RNS_KMAX + 1];
+} rns_base_t;
+// Engine for one pq. Constants are stored so that each channel product is
+// one Montgomery multiplication (mont64) with the right powers of 2^64.
+typedef struct {
+  const rns_base_t * base;
+  uint64_t x[2 * RNS_KMAX];      // State, x A mod pq in every channel.
+  uint64_t gs[RNS_KMAX], gr[RNS_KMAX];  // -pq^-1 (A / a_i)^-1, for sqr/redc.
+  uint64_t hs[RNS_KMAX], us[RNS_KMAX];  // A^-1 and pq A^-1, for sqr.
+  uint64_t hr[RNS_KMAX], ur[RNS_KMAX];  // Same times (B / b_j)^-1, for redc.
+  uint64_t bi[RNS_KMAX];                // (B / b_j)^-1.
+  uint64_t c[RNS_KMAX][3], d[3];  // B / (b_j pq), B / pq; 64.128 fixed point.
+  uint64_t xi[RNS_KMAX], y[RNS_KMAX], alpha;  // Extension terms.
+} rns_t;
+static_assert(sizeof(rns_t) <= FILL_BYTES, "rns_t outgrows the arena.");
+// a b R^-1 mod p for p < 2^63 and a b < p R (R = 2^64), with
+// pinv = -p^-1 mod R.
+static uint64_t mont64(uint64_t a, uint64_t b, uint64_t p, uint64_t pinv) {
+  dlimb_t t = (dlimb_t) a * b;
+  uint64_t m = (uint64_t) t * pinv;
+  uint64_t u = (t + (dlimb_t) m * p) >> 64;
+  return u >= p ? u - p : u;
+}
+static uint64_t pow64(uint64_t b, uint64_t e, uint64_t p) {
+  uint64_t r = 1;
+  for (; e; e >>= 1, b = (dlimb_t) b * b % p)
+    if (e & 1) r = (dlimb_t) r * b % p;
   return r;
 }
-static void bbs_nextbytes(bbs_t * bbs, void * bp, size_t len) {
-  uint8_t * buf = bp;
-#ifndef OPENMP
-  for (size_t i = 0; i < len; i++) {
-    uint8_t r = 0;
-    for (int i = 8; i != 0; --i) {
-      bbs_step(bbs); r = (r << 1) | (bbs->x & 1);
+static uint64_t mulmod64(uint64_t a, uint64_t b, uint64_t m) {
+  return m ? (dlimb_t) a * b % m : a * b;  // m = 0 stands for 2^64.
+}
+static int prime64(uint64_t n) {
+  static const uint64_t w[] = { 2, 325, 9375, 28178, 450775, 9780504,
+                                1795265022 };  // Deterministic below 2^64.
+  if (n % 3 == 0 || n % 5 == 0 || n % 7 == 0) return 0;
+  uint64_t d = n - 1;  int s = 0;
+  while (!(d & 1)) { d >>= 1; s++; }
+  for (int i = 0; i < 7; i++) {
+    uint64_t x = pow64(w[i] % n, d, n);
+    int c = x <= 1 || x == n - 1;
+    for (int r = 1; r < s && !c; r++) {
+      x = mulmod64(x, x, n);  c = x == n - 1;
     }
-    buf[i] = r;
+    if (!c) return 0;
   }
-#else
-  size_t threads;
-  #pragma omp parallel
-  {
-    #pragma omp single
-    threads = omp_get_num_threads();
+  return 1;
+}
+// out[i] = product of l[j] over j != i, mod m.
+static void rns_cofactors(uint64_t * out, const uint64_t * l, int k,
+                          uint64_t m) {
+  uint64_t p = 1;
+  for (int i = 0; i < k; i++) { out[i] = p;  p = mulmod64(p, l[i], m); }
+  p = 1;
+  for (int i = k - 1; i >= 0; i--) {
+    out[i] = mulmod64(out[i], p, m);  p = mulmod64(p, l[i], m);
   }
-  size_t chunk = len / threads;
-  #pragma omp parallel for schedule(static)
-  for (size_t i = 0; i < threads; i++) {
-    bbs_t clone = *bbs;
-    bbs_set(&clone, bbs->pos + i * chunk * 8);
-    for (size_t j = 0; j < chunk; j++) {
-      uint8_t r = 0;
-      for (int i = 8; i != 0; --i) {
-        bbs_step(&clone); r = (r << 1) | (clone.x & 1);
+}
+// r[0..k] = product of l[0..k).
+static void rns_product(limb_t * r, const uint64_t * l, int k) {
+  memset(r, 0, (k + 1) * sizeof(limb_t));  r[0] = 1;
+  for (int j = 0; j < k; j++) {
+    limb_t c = 0;
+    for (int i = 0; i <= k; i++) {
+      dlimb_t p = (dlimb_t) r[i] * l[j] + c;  r[i] = p;  c = p >> 64;
+    }
+  }
+}
+// Built on first use for each k, by the thread that then starts workers.
+static const rns_base_t * rns_base(int k) {
+  static rns_base_t * cache[8];
+  int s = 0;
+  for (; s < 8 && cache[s]; s++)
+    if (cache[s]->k == k) return cache[s];
+  rns_base_t * base = s < 8 ? calloc(1, sizeof(rns_base_t)) : NULL;
+  if (!base) eprintf("Out of memory.\n");
+  base->k = k;
+  uint64_t * a = base->m, * b = base->m + k;
+  int n = 0;
+  for (uint64_t c = ((uint64_t) 1 << 62) - 1; n < 2 * k; c -= 2)
+    if (prime64(c)) base->m[n++] = c;
+  for (int i = 0; i < 2 * k; i++) {
+    uint64_t inv = base->m[i];  // Newton's iteration, 3 -> 64 correct bits.
+    for (int j = 0; j < 5; j++) inv *= 2 - base->m[i] * inv;
+    base->minv[i] = -inv;
+    base->r1[i] = -base->m[i] % base->m[i];
+    base->r2[i] = mulmod64(base->r1[i], base->r1[i], base->m[i]);
+  }
+  base->ab = huge_alloc(2 * (size_t) k * k * sizeof(uint64_t));
+  base->ba = base->ab + (size_t) k * k;
+  for (int i = 0; i < k; i++) {
+    rns_cofactors(base->ab + (size_t) i * k, a, k, b[i]);
+    rns_cofactors(base->ba + (size_t) i * k, b, k, a[i]);
+    uint64_t pa = 1, pb = 1, qa = 1, qb = 1;
+    for (int j = 0; j < k; j++) {
+      if (j != i) {
+        pa = mulmod64(pa, a[j], a[i]);  pb = mulmod64(pb, b[j], b[i]);
       }
-      buf[i * chunk + j] = r;
+      qa = mulmod64(qa, a[j], b[i]);  qb = mulmod64(qb, b[j], a[i]);
     }
+    base->ainv[i] = pow64(pa, a[i] - 2, a[i]);
+    base->binv[i] = pow64(pb, b[i] - 2, b[i]);
+    base->amodb[i] = qa;  base->bmoda[i] = mulmod64(qb, base->r1[i], a[i]);
+    base->off += ((uint64_t) 1 << 62) - b[i];
   }
-  bbs_set(bbs, bbs->pos + len * 8);
-  size_t remainder = len % threads;
-  for (size_t i = 0; i < remainder; i++) {
-    uint8_t r = 0;
-    for (int i = 8; i != 0; --i) {
-      bbs_step(bbs); r = (r << 1) | (bbs->x & 1);
+  base->off++;
+  rns_cofactors(base->e, b, k, 0);
+  base->e0 = mulmod64(base->e[0], b[0], 0);
+  rns_product(base->a, a, k);  rns_product(base->b, b, k);
+  return cache[s] = base;
+}
+// n mod m for n[0..nl).
+static uint64_t rns_mod(const limb_t * n, int nl, uint64_t m) {
+  dlimb_t r = 0;
+  for (int i = nl - 1; i >= 0; i--) r = (r << 64 | n[i]) % m;
+  return r;
+}
+// Constants for pq = n[0..nl), given d[0..dl) = floor(B 2^128 / pq).
+static void rns_load(rns_t * r, const rns_base_t * base, const limb_t * n,
+                     int nl, const limb_t * d, int dl) {
+  int k = base->k;
+  r->base = base;
+  for (int i = 0; i < 2 * k; i++) {
+    uint64_t m = base->m[i], r1 = base->r1[i], r2 = base->r2[i];
+    uint64_t nm = rns_mod(n, nl, m);
+    if (i < k) {
+      uint64_t g = mulmod64(m - pow64(nm, m - 2, m), base->ainv[i], m);
+      r->gr[i] = mulmod64(g, r1, m);  r->gs[i] = mulmod64(g, r2, m);
+    } else {
+      int j = i - k;
+      uint64_t ai = pow64(base->amodb[j], m - 2, m), bi = base->binv[j];
+      uint64_t na = mulmod64(nm, ai, m);
+      r->hs[j] = mulmod64(ai, r2, m);  r->us[j] = mulmod64(na, r2, m);
+      r->hr[j] = mulmod64(mulmod64(ai, bi, m), r1, m);
+      r->ur[j] = mulmod64(mulmod64(na, bi, m), r2, m);
+      r->bi[j] = mulmod64(bi, r1, m);
+      dlimb_t rem = 0;  // Low 192 bits of d / b_j.
+      for (int l = dl - 1; l >= 0; l--) {
+        rem = rem << 64 | d[l];
+        if (l < 3) r->c[j][l] = rem / m;
+        rem %= m;
+      }
     }
-    buf[len - remainder + i] = r;
   }
-#endif
+  for (int l = 0; l < 3; l++) r->d[l] = l < dl ? d[l] : 0;
+}
+// Loads the state from x[0..nl), which must already be x A mod pq.
+static void rns_set(rns_t * r, const limb_t * x, int nl) {
+  for (int i = 0; i < 2 * r->base->k; i++)
+    r->x[i] = rns_mod(x, nl, r->base->m[i]);
+}
+// Sum of x[i] w[i] over i < k, times 2^-64 mod channel c. The three
+// words of the sum are reduced by Montgomery multiplications, not
+// divisions, hence the extra factor.
+static uint64_t rns_dot(const rns_base_t * base, const uint64_t * x,
+                        const uint64_t * w, int c) {
+  uint64_t m = base->m[c], mv = base->minv[c];
+  dlimb_t acc = 0;  uint64_t hi = 0;
+  for (int i = 0; i < base->k; i++) {
+    dlimb_t p = (dlimb_t) x[i] * w[i];
+    acc += p;  hi += acc < p;
+  }
+  uint64_t s = mont64((uint64_t) acc, 1, m, mv)
+             + mont64(acc >> 64, base->r1[c], m, mv);
+  s = s >= m ? s - m : s;
+  s += mont64(hi, base->r2[c], m, mv);
+  return s >= m ? s - m : s;
+}
+// Extends the B channels to A: every a_i gets the y_j B / b_j terms
+// minus alpha B, with alpha = floor(sum of y_j / b_j) estimated as
+// floor((sum of y_j + off) / 2^62). Exact for values below B (1 - off 2^-62).
+static void rns_extend(rns_t * r) {
+  const rns_base_t * base = r->base;  int k = base->k;
+  dlimb_t s = base->off;
+  for (int j = 0; j < k; j++) s += r->y[j];
+  r->alpha = s >> 62;
+  for (int i = 0; i < k; i++) {
+    uint64_t a = base->m[i], av = base->minv[i];
+    uint64_t v = rns_dot(base, r->y, base->ba + (size_t) i * k, i);
+    v = mont64(v, base->r2[i], a, av);
+    uint64_t w = mont64(r->alpha, base->bmoda[i], a, av);
+    r->x[i] = v >= w ? v - w : v + a - w;
+  }
+}
+// x = x^2 A^-1 mod pq, up to a multiple of pq: q = -x^2 pq^-1 mod A in A,
+// extended to B as q + t A (t < k), then (x^2 + (q + t A) pq) / A in B,
+// extended back to A.
+static void rns_sqr(rns_t * r) {
+  const rns_base_t * base = r->base;  int k = base->k;
+  const uint64_t * m = base->m, * minv = base->minv;
+  for (int i = 0; i < k; i++) {
+    uint64_t s = mont64(r->x[i], r->x[i], m[i], minv[i]);
+    r->xi[i] = mont64(s, r->gs[i], m[i], minv[i]);
+  }
+  for (int j = 0; j < k; j++) {
+    uint64_t b = m[k + j], bv = minv[k + j], x = r->x[k + j];
+    uint64_t q = rns_dot(base, r->xi, base->ab + (size_t) j * k, k + j);
+    uint64_t s = mont64(mont64(x, x, b, bv), r->hs[j], b, bv)
+               + mont64(q, r->us[j], b, bv);
+    r->x[k + j] = s >= b ? s - b : s;
+    r->y[j] = mont64(r->x[k + j], r->bi[j], b, bv);
+  }
+  rns_extend(r);
+}
+// Leaves in y and alpha the B side of z = x A^-1 mod pq, up to a
+// multiple of pq: z is below (k + 1) pq and congruent to the plain state.
+static void rns_redc(rns_t * r) {
+  const rns_base_t * base = r->base;  int k = base->k;
+  const uint64_t * m = base->m, * minv = base->minv;
+  for (int i = 0; i < k; i++)
+    r->xi[i] = mont64(r->x[i], r->gr[i], m[i], minv[i]);
+  dlimb_t s = base->off;
+  for (int j = 0; j < k; j++) {
+    uint64_t b = m[k + j], bv = minv[k + j];
+    uint64_t q = rns_dot(base, r->xi, base->ab + (size_t) j * k, k + j);
+    uint64_t t = mont64(r->x[k + j], r->hr[j], b, bv)
+               + mont64(q, r->ur[j], b, bv);
+    r->y[j] = t >= b ? t - b : t;  s += r->y[j];
+  }
+  r->alpha = s >> 62;
+}
+// Parity of the plain state, or -1 if the caller must find it exactly.
+// z mod 2^64 and floor(z / pq) are both sums over the y_j; the estimate
+// of z / pq is low by less than 2^-55 and high by less than 2^-64.
+static int rns_parity(rns_t * r) {
+  const rns_base_t * base = r->base;  int k = base->k;
+  rns_redc(r);
+  uint64_t lo = -(r->alpha * base->e0);
+  limb_t e[3] = { 0 }, t[3];
+  for (int j = 0; j < k; j++) {
+    uint64_t y = r->y[j];
+    lo += y * base->e[j];
+    dlimb_t p0 = (dlimb_t) y * r->c[j][0];
+    dlimb_t p1 = (dlimb_t) y * r->c[j][1] + (limb_t) (p0 >> 64);
+    t[0] = p0;  t[1] = p1;  t[2] = (limb_t) (p1 >> 64) + y * r->c[j][2];
+    add_n(e, e, t, 3);
+  }
+  dlimb_t p0 = (dlimb_t) r->alpha * r->d[0];
+  dlimb_t p1 = (dlimb_t) r->alpha * r->d[1] + (limb_t) (p0 >> 64);
+  t[0] = p0;  t[1] = p1;  t[2] = (limb_t) (p1 >> 64) + r->alpha * r->d[2];
+  sub_n(e, e, t, 3);
+  if (e[1] == 0 || e[1] >= -(limb_t) 1024) return -1;
+  return (lo ^ e[2]) & 1;  // pq is odd.
+}
+// z[0..k] = the value rns_redc left in y and alpha.
+static void rns_value(const rns_t * r, limb_t * z) {
+  const rns_base_t * base = r->base;  int k = base->k;
+  limb_t t[RNS_KMAX + 1];
+  memset(z, 0, (k + 1) * sizeof(limb_t));
+  for (int j = 0; j < k; j++) {
+    uint64_t b = base->m[k + j];  dlimb_t rem = 0;  limb_t c = 0;
+    for (int i = k; i >= 0; i--) {
+      rem = rem << 64 | base->b[i];  t[i] = rem / b;  rem %= b;
+    }
+    for (int i = 0; i <= k; i++) {
+      dlimb_t p = (dlimb_t) t[i] * r->y[j] + z[i] + c;  z[i] = p;  c = p >> 64;
+    }
+  }
+  limb_t c = 0;
+  for (int i = 0; i <= k; i++) {
+    dlimb_t p = (dlimb_t) base->b[i] * r->alpha + c;  t[i] = p;  c = p >> 64;
+  }
+  sub_n(z, z, t, k + 1);
 }
 
 // ---------------------------------------------------------------------------
-//      CLI stub. By default, the program will output
-//      an infinite stream of random numbers to stdout (64-bit,
-//      native endian). If changed, it displays an experiment.
+//      Size instantiations. Each inclusion of bbs-core.h defines a complete
+//      generator for one N_BITS and exports it as `bbs_ops_t ops_N_BITS'.
+//      The handle passed to the entry points is that size's bbs_t.
 // ---------------------------------------------------------------------------
-#if 0
-int main(void) {
-  init_secrandom();  populate_barrett_cache();
-  bbs_t bbs;  bbs_new(&bbs);
-  uint8_t * buffer = malloc(1 << 24);
+typedef struct {
+  int bits;
+  size_t size;                                        // sizeof(bbs_t).
+  void (*init)(void);
+  void (*fini)(void);                   // Frees what init made.
+  void (*create)(void * bbs);
+  void (*load)(void * bbs, const char * p, const char * q, const char * x);
+  void (*save)(const void * bbs, FILE * f);          // `p', `q', `x' lines.
+  void (*spawn)(void * bbs, const void * parent,      // Same pq, seed x or
+                const char * x);                      // a new one if NULL.
+  void (*release)(void * bbs);                        // Frees the context.
+  void (*rekey)(void);                  // Makes a new pq in the background.
+  int (*swap)(void * bbs);              // Moves to it if ready.
+  void (*set)(void * bbs, uint64_t i);
+  uint64_t (*tell)(const void * bbs);
+  void (*substream)(void * sub, const void * bbs, uint64_t k, uint64_t stride);
+  void (*nextbytes)(void * bbs, void * buf, size_t len);
+  void (*nextbytes_lanes)(void * bbs, void * buf, size_t len);
+  void (*nextbytes_rns)(void * bbs, void * buf, size_t len);
+  int (*kat)(void);
+  void (*trial)(int count);             // Compares trial division engines.
+} bbs_ops_t;
+#include "kat.h"
+#define N_BITS 512
+#include "bbs-core.h"
+#undef N_BITS
+#define N_BITS 1024
+#include "bbs-core.h"
+#undef N_BITS
+#define N_BITS 2048
+#include "bbs-core.h"
+#undef N_BITS
+#define N_BITS 4096
+#include "bbs-core.h"
+#undef N_BITS
+#define N_BITS 8192
+#include "bbs-core.h"
+#undef N_BITS
+#ifdef LARGE
+  #if !defined(BITINT_MAXWIDTH) || BITINT_MAXWIDTH < 2 * MAX_BITS
+    #error "-DLARGE needs _BitInt(131072) support."
+  #endif
+  #define N_BITS 16384
+  #include "bbs-core.h"
+  #undef N_BITS
+  #define N_BITS 32768
+  #include "bbs-core.h"
+  #undef N_BITS
+  #define N_BITS 65536
+  #include "bbs-core.h"
+  #undef N_BITS
+#endif
+static const bbs_ops_t * const sizes[] = {
+  &ops_512, &ops_1024, &ops_2048, &ops_4096, &ops_8192,
+#ifdef LARGE
+  &ops_16384, &ops_32768, &ops_65536
+#endif
+};
+
+// ---------------------------------------------------------------------------
+//      Library interface, see cbbs.h. A cbbs_ctx_t holds a generator of
+//      its own, which owns the bbs_ctx_t, and the generators handed out
+//      are spawned from it. The tables of a size are made with its first
+//      context, one size at a time. -DLIBRARY leaves out the CLI below.
+// ---------------------------------------------------------------------------
+#include "cbbs.h"
+struct cbbs_ctx { const bbs_ops_t * ops; void * bbs; };
+struct cbbs_gen { const bbs_ops_t * ops; void * bbs; };
+// lib_lock serializes the first use of a size, so callers wait for its
+// tables to be made rather than spin on the CPU that makes them.
+#ifdef _WIN32
+static SRWLOCK lib_lock = SRWLOCK_INIT;
+static void lib_enter(void) { AcquireSRWLockExclusive(&lib_lock); }
+static void lib_leave(void) { ReleaseSRWLockExclusive(&lib_lock); }
+#else
+#include <pthread.h>
+static pthread_mutex_t lib_lock = PTHREAD_MUTEX_INITIALIZER;
+static void lib_enter(void) { pthread_mutex_lock(&lib_lock); }
+static void lib_leave(void) { pthread_mutex_unlock(&lib_lock); }
+#endif
+static void * lib_alloc(size_t size) {
+  void * p = malloc(size);
+  if (!p) eprintf("Out of memory.\n");
+  return p;
+}
+int cbbs_init(const char * kernel) {
+  if (kernel && !find_kernel(kernel)) return -1;
+  mem_init();  init_secrandom();  select_lanes();
+  if (kernel) select_kernel(kernel, 0);
+  else {
+    kern = NULL;
+    kern_auto[0] = best_kernel(0);  kern_auto[1] = best_kernel(4096);
+  }
+  return 0;
+}
+void cbbs_teardown(void) {
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    sizes[i]->fini();
+  free(primorial);  primorial = NULL;
+  close_secrandom();  scratch_free();
+}
+static cbbs_ctx_t * lib_ctx(int bits, const char * p, const char * q) {
+  const bbs_ops_t * o = NULL;
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    if (sizes[i]->bits == (bits ? bits : DEFAULT_BITS)) o = sizes[i];
+  if (!o) return NULL;
+  lib_enter();  o->init();  lib_leave();
+  cbbs_ctx_t * ctx = lib_alloc(sizeof(cbbs_ctx_t));
+  ctx->ops = o;  ctx->bbs = lib_alloc(o->size);
+  if (p) o->load(ctx->bbs, p, q, NULL);
+  else o->create(ctx->bbs);
+  return ctx;
+}
+cbbs_ctx_t * cbbs_ctx_new(int bits) { return lib_ctx(bits, NULL, NULL); }
+cbbs_ctx_t * cbbs_ctx_load(int bits, const char * p, const char * q) {
+  return lib_ctx(bits, p, q);
+}
+void cbbs_ctx_free(cbbs_ctx_t * ctx) {
+  if (!ctx) return;
+  ctx->ops->release(ctx->bbs);
+  free(ctx->bbs);  free(ctx);
+}
+int cbbs_ctx_bits(const cbbs_ctx_t * ctx) { return ctx->ops->bits; }
+cbbs_t * cbbs_new(const cbbs_ctx_t * ctx, const char * x) {
+  cbbs_t * bbs = lib_alloc(sizeof(cbbs_t));
+  bbs->ops = ctx->ops;  bbs->bbs = lib_alloc(ctx->ops->size);
+  ctx->ops->spawn(bbs->bbs, ctx->bbs, x);
+  return bbs;
+}
+void cbbs_free(cbbs_t * bbs) {
+  if (!bbs) return;
+  free(bbs->bbs);  free(bbs);
+}
+void cbbs_read(cbbs_t * bbs, void * buf, size_t len) {
+  bbs->ops->nextbytes(bbs->bbs, buf, len);
+}
+// Asynchronous reads are queued for one reader thread, started by the
+// first of them and kept like the pool, so its scratch arena is reused.
+// It runs them in order and its par_run calls go to the pool as from
+// any caller. OpenMP builds start the reader with pthreads as well.
+typedef struct lib_read {
+  cbbs_t * bbs;  void * buf;  size_t len;
+  void (*done)(void *);  void * arg;
+  struct lib_read * next;
+} lib_read_t;
+#if defined(PTHREADS) || defined(OPENMP)
+#include <pthread.h>
+static pthread_mutex_t read_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t read_wake = PTHREAD_COND_INITIALIZER;
+static lib_read_t * read_head, ** read_tail = &read_head;
+static void * lib_reader(void * p) {
+  (void) p;
+  pthread_mutex_lock(&read_lock);
   for (;;) {
-    bbs_nextbytes(&bbs, buffer, 1 << 24);
-    fwrite(buffer, 1, 1 << 24, stdout);
+    while (!read_head) pthread_cond_wait(&read_wake, &read_lock);
+    lib_read_t job = *read_head;
+    free(read_head);
+    if (!(read_head = job.next)) read_tail = &read_head;
+    pthread_mutex_unlock(&read_lock);
+    cbbs_read(job.bbs, job.buf, job.len);
+    job.done(job.arg);
+    pthread_mutex_lock(&read_lock);
   }
+  return NULL;
+}
+void cbbs_read_async(cbbs_t * bbs, void * buf, size_t len,
+                     void (*done)(void *), void * arg) {
+  static int started;
+  lib_read_t * job = lib_alloc(sizeof(lib_read_t));
+  *job = (lib_read_t) { bbs, buf, len, done, arg, NULL };
+  pthread_mutex_lock(&read_lock);
+  if (!started) {
+    pthread_t t;
+    int e = pthread_create(&t, NULL, lib_reader, NULL);
+    if (e) eprintf("Could not start the reader thread: %s\n", strerror(e));
+    pthread_detach(t);
+    started = 1;
+  }
+  *read_tail = job;  read_tail = &job->next;
+  pthread_cond_signal(&read_wake);
+  pthread_mutex_unlock(&read_lock);
 }
 #else
-int main(void) {
-  init_secrandom();  populate_barrett_cache();
-  bbs_t bbs;  bbs_new(&bbs);
+void cbbs_read_async(cbbs_t * bbs, void * buf, size_t len,
+                     void (*done)(void *), void * arg) {
+  cbbs_read(bbs, buf, len);
+  done(arg);
+}
+#endif
+void cbbs_seek(cbbs_t * bbs, uint64_t pos) { bbs->ops->set(bbs->bbs, pos); }
+uint64_t cbbs_tell(const cbbs_t * bbs) { return bbs->ops->tell(bbs->bbs); }
+
+#ifndef LIBRARY
+
+// ---------------------------------------------------------------------------
+//      CLI stub. By default, the program displays an experiment.
+//      With `-s', it outputs a stream of random bytes to stdout
+//      (infinite, unless limited with `-n bytes'). With `-b', it
+//      measures the throughput of generating `-n' bytes (1 MiB default).
+//      `-k' checks the known-answer vectors from kat.h. `-L' makes
+//      `-s' and `-b' fill their buffers with the multi-lane engine,
+//      `-R' with the RNS engine.
+//      `-r seconds' makes `-s' rotate to a fresh modulus and seed at
+//      that interval, made in the background in the meantime.
+//      `-o offset' starts `-s' at that byte of the keystream.
+//      `-N bits' selects the modulus size (8192 by default); without it,
+//      `-k' checks every size. `-M', `-W', `-V' and `-J' run sharded
+//      jobs, `-C' and `-X' make and serve keystream caches, see below.
+//
+//      For reproducible runs, `-p hex -q hex [-x hex]' fixes the
+//      parameters, while `-S seed' replaces the entropy source with
+//      a deterministic one. `-K generic|adx|ifma' forces a kernel.
+//      `-t gcd' makes the prime search's trial division one GCD with the
+//      primorial instead of one residue test per prime (`-t residue');
+//      `-T' times both on `-n' candidates (1000 by default).
+// ---------------------------------------------------------------------------
+static const bbs_ops_t * ops;
+static void (*fill)(void *, void *, size_t);
+static double rotate;
+// Output buffers are never touched before they are filled: each page is
+// then placed on the NUMA node of the worker that first writes it.
+// Returns the number of bytes written.
+static unsigned long long stream(void * bbs, unsigned long long limit,
+                                 FILE * out) {
+  uint8_t * buffer = huge_alloc(1 << 24);
+  unsigned long long done = 0;
+  double due = seconds() + rotate;
+  if (rotate) ops->rekey();
+  while (!limit || done < limit) {
+    if (rotate && seconds() >= due && ops->swap(bbs)) {
+      ops->rekey();  due = seconds() + rotate;
+    }
+    size_t len = 1 << 24;
+    if (limit && limit - done < len) len = limit - done;
+    fill(bbs, buffer, len);
+    TRACE_BEGIN(t0);
+    size_t written = fwrite(buffer, 1, len, out);
+    TRACE_END("write", t0);
+    done += written;
+    if (written != len) break;
+  }
+  huge_free(buffer, 1 << 24);
+  return done;
+}
+static void bench(void * bbs, unsigned long long len) {
+  uint8_t * buffer = huge_alloc(len);
+  double t0 = seconds();
+  fill(bbs, buffer, len);
+  double t1 = seconds();
+  printf("Generated %llu bytes in %.3f s (%.1f KiB/s).\n",
+         len, t1 - t0, len / (t1 - t0) / 1024);
+  huge_free(buffer, len);
+}
+static void experiment(void * bbs) {
   uint8_t buf[64];
-  printf("Current position: %d\n", bbs.pos);
+  printf("Current position: %llu\n", (unsigned long long) ops->tell(bbs));
   printf("Probing 64 bytes of data: ");
-  bbs_nextbytes(&bbs, buf, 64);
+  ops->nextbytes(bbs, buf, 64);
   for (int i = 0; i < 64; i++)
     printf("%02x", buf[i]);
   printf("\n");
-  printf("Current position: %d\n", bbs.pos);
+  printf("Current position: %llu\n", (unsigned long long) ops->tell(bbs));
   printf("Probing another 64 bytes of data: ");
-  bbs_nextbytes(&bbs, buf, 64);
+  ops->nextbytes(bbs, buf, 64);
   for (int i = 0; i < 64; i++)
     printf("%02x", buf[i]);
   printf("\n");
   printf("Rewinding to position 512.\n");
-  bbs_set(&bbs, 512);
-  printf("Current position: %d\n", bbs.pos);
+  ops->set(bbs, 512);
+  printf("Current position: %llu\n", (unsigned long long) ops->tell(bbs));
+  printf("Probing 64 bytes of data: ");
+  ops->nextbytes(bbs, buf, 64);
+  for (int i = 0; i < 64; i++)
+    printf("%02x", buf[i]);
+  printf("\n");
+  printf("Opening substream 3 of stride 2^40.\n");
+  void * other = malloc(ops->size);
+  ops->substream(other, bbs, 3, (uint64_t) 1 << 40);
+  printf("Current position: %llu\n", (unsigned long long) ops->tell(other));
   printf("Probing 64 bytes of data: ");
-  bbs_nextbytes(&bbs, buf, 64);
+  ops->nextbytes(other, buf, 64);
   for (int i = 0; i < 64; i++)
     printf("%02x", buf[i]);
   printf("\n");
+  printf("Spawning a generator with a new seed over the same modulus.\n");
+  ops->spawn(other, bbs, NULL);
+  printf("Probing 64 bytes of data: ");
+  ops->nextbytes(other, buf, 64);
+  for (int i = 0; i < 64; i++)
+    printf("%02x", buf[i]);
+  printf("\n");
+  free(other);
+}
+// ---------------------------------------------------------------------------
+//      Sharded jobs. `-M job -n bytes -w shards' writes a manifest that
+//      splits the first `-n' bytes of one parameter set into contiguous
+//      ranges of near-equal size. `-W job -i k' generates range k into
+//      the file the manifest names for it; workers share nothing but
+//      the manifest, so they may run as separate processes or hosts.
+//      `-V job' checks every shard file: its length, and its first and
+//      last 64 bytes against freshly seeked output. `-J job' does the
+//      same while concatenating the shards to stdout, and stops at the
+//      first damaged one.
+// ---------------------------------------------------------------------------
+typedef struct { unsigned long long start, len; char * file; } shard_t;
+typedef struct {
+  int bits, n;
+  char * p, * q, * x;
+  shard_t * shard;
+} manifest_t;
+static void write_manifest(const char * path, const void * bbs,
+                           unsigned long long total, int n) {
+  FILE * f = fopen(path, "w");
+  if (!f) eprintf("Could not create `%s': %s\n", path, strerror(errno));
+  fprintf(f, "cbbs-manifest 1\nbits %d\n", ops->bits);
+  ops->save(bbs, f);
+  fprintf(f, "shards %d\n", n);
+  unsigned long long base = total / n, r = total % n;
+  for (int i = 0; i < n; i++) {
+    unsigned long long k = i, start = k * base + (k < r ? k : r);
+    fprintf(f, "shard %d %llu %llu %s.%d\n", i, start, base + (k < r),
+            path, i);
+  }
+  if (ferror(f) | fclose(f))
+    eprintf("Could not write `%s': %s\n", path, strerror(errno));
+}
+static void read_manifest(const char * path, manifest_t * m) {
+  static char line[MAX_BITS / 4 + FILENAME_MAX + 64];
+  FILE * f = fopen(path, "r");
+  if (!f) eprintf("Could not open `%s': %s\n", path, strerror(errno));
+  memset(m, 0, sizeof(*m));
+  if (!fgets(line, sizeof(line), f) || strcmp(line, "cbbs-manifest 1\n"))
+    eprintf("`%s' is not a version 1 manifest.\n", path);
+  while (fgets(line, sizeof(line), f)) {
+    size_t l = strlen(line);
+    if (line[l - 1] == '\n') line[--l] = 0;
+    else if (!feof(f)) eprintf("Overlong line in `%s'.\n", path);
+    char * v = strchr(line, ' ');
+    if (!v) eprintf("Malformed line in `%s': %s\n", path, line);
+    *v++ = 0;
+    if (!strcmp(line, "bits")) m->bits = atoi(v);
+    else if (!strcmp(line, "p")) m->p = strdup(v);
+    else if (!strcmp(line, "q")) m->q = strdup(v);
+    else if (!strcmp(line, "x")) m->x = strdup(v);
+    else if (!strcmp(line, "shards") && !m->shard && (m->n = atoi(v)) > 0)
+      m->shard = calloc(m->n, sizeof(shard_t));
+    else if (!strcmp(line, "shard") && m->shard) {
+      int i, o = 0;  unsigned long long start, len;
+      if (sscanf(v, "%d %llu %llu %n", &i, &start, &len, &o) != 3 || !o
+       || i < 0 || i >= m->n || !len || !v[o])
+        eprintf("Malformed shard in `%s': %s\n", path, v);
+      m->shard[i] = (shard_t) { start, len, strdup(v + o) };
+    } else eprintf("Unexpected `%s' in `%s'.\n", line, path);
+  }
+  fclose(f);
+  if (!m->bits || !m->p || !m->q || !m->x || !m->shard)
+    eprintf("Incomplete manifest `%s'.\n", path);
+  for (int i = 0; i < m->n; i++)
+    if (!m->shard[i].file || m->shard[i].start != (i ? m->shard[i - 1].start
+                                                 + m->shard[i - 1].len : 0))
+      eprintf("Shard %d is missing or not contiguous in `%s'.\n", i, path);
+  if (m->shard[m->n - 1].start + m->shard[m->n - 1].len > UINT64_MAX / 8)
+    eprintf("The job in `%s' exceeds 2^64 bits.\n", path);
+}
+static void run_shard(void * bbs, const manifest_t * m, int k) {
+  if (k < 0 || k >= m->n) eprintf("No shard %d in the manifest.\n", k);
+  const shard_t * s = &m->shard[k];
+  FILE * f = fopen(s->file, "wb");
+  if (!f) eprintf("Could not create `%s': %s\n", s->file, strerror(errno));
+  ops->set(bbs, s->start * 8);
+  if (stream(bbs, s->len, f) != s->len || fclose(f))
+    eprintf("Could not write `%s': %s\n", s->file, strerror(errno));
+}
+// Reads a shard file through, copying it to out unless that is NULL.
+// Returns non-zero if the file is missing, has the wrong length, or
+// its first or last 64 bytes differ from the generator's.
+static int check_shard(void * bbs, const shard_t * s, FILE * out) {
+  uint8_t head[64], tail[64], want[64];
+  FILE * f = fopen(s->file, "rb");
+  if (!f) {
+    fprintf(stderr, "Could not open `%s': %s\n", s->file, strerror(errno));
+    return 1;
+  }
+  uint8_t * buffer = huge_alloc(1 << 24);
+  unsigned long long size = 0;  size_t r;
+  while ((r = fread(buffer, 1, 1 << 24, f)) > 0) {
+    if (size < 64) memcpy(head + size, buffer, r < 64 - size ? r : 64 - size);
+    if (r >= 64) memcpy(tail, buffer + r - 64, 64);
+    else memmove(tail, tail + r, 64 - r), memcpy(tail + 64 - r, buffer, r);
+    size += r;
+    if (out && fwrite(buffer, 1, r, out) != r) eprintf("Write error.\n");
+  }
+  int bad = ferror(f) || size != s->len;
+  fclose(f);  huge_free(buffer, 1 << 24);
+  if (bad) return 1;
+  size_t n = s->len < 64 ? s->len : 64;
+  ops->set(bbs, s->start * 8);
+  ops->nextbytes(bbs, want, n);
+  bad |= memcmp(head, want, n) != 0;
+  ops->set(bbs, (s->start + s->len - n) * 8);
+  ops->nextbytes(bbs, want, n);
+  return bad | (memcmp(tail + 64 - n, want, n) != 0);
+}
+static int run_job(void * bbs, const manifest_t * m, int join) {
+  int failed = 0;
+  for (int i = 0; i < m->n; i++) {
+    int bad = check_shard(bbs, &m->shard[i], join ? stdout : NULL);
+    if (join && bad)
+      eprintf("Shard %d (`%s') is damaged.\n", i, m->shard[i].file);
+    if (!join)
+      printf("Shard %d (`%s'): %s\n", i, m->shard[i].file,
+             bad ? "FAILED" : "ok");
+    failed |= bad;
+  }
+  return failed;
+}
+
+// ---------------------------------------------------------------------------
+//      Keystream caches, for consumers that replay the same ranges of a
+//      stream over and over. `-C cache -g ranges' writes the parameters
+//      and the byte ranges `start:len[,start:len...]' of the keystream
+//      to one file (`-o offset -n bytes' for a single range): a text
+//      header with a range index, then the ranges back to back. `-X
+//      cache [-o offset] [-n bytes]' writes that part of the keystream to
+//      stdout, copying cached ranges out of the file, mapped into memory
+//      where possible, and generating the gaps from seeks. Like a
+//      manifest, a cache holds everything needed to reproduce the
+//      keystream.
+// ---------------------------------------------------------------------------
+#if defined(__unix__) && !defined(__linux__)
+#include <sys/mman.h>
+#endif
+typedef struct { unsigned long long start, len, at; } range_t;
+typedef struct {
+  int bits, n;
+  char * p, * q, * x;
+  range_t * r;                // Sorted and disjoint; `at' is a file offset.
+  FILE * f;
+  const uint8_t * map;        // The whole file, if mapped.
+} cache_t;
+static int range_cmp(const void * a, const void * b) {
+  const range_t * x = a, * y = b;
+  return (x->start > y->start) - (x->start < y->start);
+}
+// Sorts the ranges and merges those that overlap or touch. Returns the
+// number left.
+static int merge_ranges(range_t * r, int n) {
+  qsort(r, n, sizeof(range_t), range_cmp);
+  int k = 0;
+  for (int i = 1; i < n; i++) {
+    unsigned long long end = r[i].start + r[i].len;
+    if (r[i].start > r[k].start + r[k].len) r[++k] = r[i];
+    else if (end > r[k].start + r[k].len) r[k].len = end - r[k].start;
+  }
+  return k + 1;
+}
+static int parse_ranges(const char * list, range_t ** out) {
+  int n = 1;
+  for (const char * t = list; *t; t++) n += *t == ',';
+  range_t * r = malloc(n * sizeof(range_t));
+  if (!r) eprintf("Out of memory.\n");
+  const char * s = list;
+  for (int i = 0; i < n; i++) {
+    char * e;
+    r[i].start = strtoull(s, &e, 0);
+    if (*e == ':') r[i].len = strtoull(e + 1, &e, 0);
+    if (e == s || (*e && *e != ',') || !r[i].len)
+      eprintf("Malformed range list `%s'.\n", list);
+    if (r[i].start > UINT64_MAX / 8 || r[i].len > UINT64_MAX / 8 - r[i].start)
+      eprintf("The range list exceeds 2^64 bits.\n");
+    s = e + 1;
+  }
+  *out = r;
+  return merge_ranges(r, n);
+}
+static void write_cache(const char * path, void * bbs, const range_t * r,
+                        int n) {
+  FILE * f = fopen(path, "wb");
+  if (!f) eprintf("Could not create `%s': %s\n", path, strerror(errno));
+  fprintf(f, "cbbs-cache 1\nbits %d\n", ops->bits);
+  ops->save(bbs, f);
+  fprintf(f, "ranges %d\n", n);
+  for (int i = 0; i < n; i++)
+    fprintf(f, "range %llu %llu\n", r[i].start, r[i].len);
+  fprintf(f, "data\n");
+  for (int i = 0; i < n; i++) {
+    ops->set(bbs, r[i].start * 8);
+    if (stream(bbs, r[i].len, f) != r[i].len) break;
+  }
+  if (ferror(f) | fclose(f))
+    eprintf("Could not write `%s': %s\n", path, strerror(errno));
+}
+static void read_cache(const char * path, cache_t * c) {
+  static char line[MAX_BITS / 4 + 64];
+  FILE * f = fopen(path, "rb");
+  if (!f) eprintf("Could not open `%s': %s\n", path, strerror(errno));
+  memset(c, 0, sizeof(*c));
+  if (!fgets(line, sizeof(line), f) || strcmp(line, "cbbs-cache 1\n"))
+    eprintf("`%s' is not a version 1 cache.\n", path);
+  int k = 0;
+  while (fgets(line, sizeof(line), f) && strcmp(line, "data\n")) {
+    size_t l = strlen(line);
+    if (line[l - 1] == '\n') line[--l] = 0;
+    else eprintf("Overlong or truncated line in `%s'.\n", path);
+    char * v = strchr(line, ' ');
+    if (!v) eprintf("Malformed line in `%s': %s\n", path, line);
+    *v++ = 0;
+    if (!strcmp(line, "bits")) c->bits = atoi(v);
+    else if (!strcmp(line, "p")) c->p = strdup(v);
+    else if (!strcmp(line, "q")) c->q = strdup(v);
+    else if (!strcmp(line, "x")) c->x = strdup(v);
+    else if (!strcmp(line, "ranges") && !c->r && (c->n = atoi(v)) > 0)
+      c->r = calloc(c->n, sizeof(range_t));
+    else if (!strcmp(line, "range") && c->r && k < c->n) {
+      range_t * r = &c->r[k++];
+      if (sscanf(v, "%llu %llu", &r->start, &r->len) != 2 || !r->len
+       || r->start > UINT64_MAX / 8 || r->len > UINT64_MAX / 8 - r->start
+       || (k > 1 && r->start <= r[-1].start + r[-1].len))
+        eprintf("Malformed range in `%s': %s\n", path, v);
+    } else eprintf("Unexpected `%s' in `%s'.\n", line, path);
+  }
+  if (!c->bits || !c->p || !c->q || !c->x || !c->r || k != c->n)
+    eprintf("Incomplete cache `%s'.\n", path);
+  unsigned long long at = ftell(f);
+  for (int i = 0; i < c->n; i++) c->r[i].at = at, at += c->r[i].len;
+  fseek(f, 0, SEEK_END);
+  if ((unsigned long long) ftell(f) != at)
+    eprintf("`%s' does not hold the ranges it lists.\n", path);
+  c->f = f;
+#if defined(__unix__)
+  void * map = mmap(NULL, at, PROT_READ, MAP_SHARED, fileno(f), 0);
+  if (map != MAP_FAILED) c->map = map;
+#endif
+}
+// Copies len bytes at file offset `at' to out. Returns zero on failure.
+static int cache_copy(const cache_t * c, unsigned long long at,
+                      unsigned long long len, FILE * out) {
+  if (c->map) return fwrite(c->map + at, 1, len, out) == len;
+  uint8_t * buffer = huge_alloc(1 << 24);
+  int ok = !fseek(c->f, at, SEEK_SET);
+  while (ok && len) {
+    size_t n = len < 1 << 24 ? len : 1 << 24;
+    ok = fread(buffer, 1, n, c->f) == n && fwrite(buffer, 1, n, out) == n;
+    len -= n;
+  }
+  huge_free(buffer, 1 << 24);
+  return ok;
+}
+// Writes bytes [from, from + len) of the keystream to out, or all from
+// `from' on if len is 0.
+static void serve_cache(void * bbs, const cache_t * c,
+                        unsigned long long from, unsigned long long len,
+                        FILE * out) {
+  unsigned long long end = len ? from + len : ULLONG_MAX;
+  for (int i = 0; from < end; ) {
+    while (i < c->n && c->r[i].start + c->r[i].len <= from) i++;
+    if (i < c->n && c->r[i].start <= from) {
+      const range_t * r = &c->r[i];
+      unsigned long long to = r->start + r->len < end ? r->start + r->len
+                                                      : end;
+      if (!cache_copy(c, r->at + (from - r->start), to - from, out)) return;
+      from = to;
+    } else {
+      unsigned long long to = i < c->n && c->r[i].start < end
+                            ? c->r[i].start : end;
+      if (ops->tell(bbs) != from * 8) ops->set(bbs, from * 8);
+      if (to == ULLONG_MAX) { stream(bbs, 0, out);  return; }
+      if (stream(bbs, to - from, out) != to - from) return;
+      from = to;
+    }
+  }
+}
+int main(int argc, char * argv[]) {
+  int mode = 0, bits = 0, engine = 0, shards = 0, shard = -1, status = 0;
+  const char * ps = NULL, * qs = NULL, * xs = NULL, * ks = NULL;
+  const char * job = NULL, * gs = NULL;  manifest_t m = { 0 };
+  unsigned long long limit = 0, offset = 0;  cache_t c = { 0 };
+  mem_init();
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-s") || !strcmp(argv[i], "-b")
+     || !strcmp(argv[i], "-k") || !strcmp(argv[i], "-T")) mode = argv[i][1];
+    else if ((!strcmp(argv[i], "-M") || !strcmp(argv[i], "-W")
+           || !strcmp(argv[i], "-V") || !strcmp(argv[i], "-J")
+           || !strcmp(argv[i], "-C") || !strcmp(argv[i], "-X"))
+          && i + 1 < argc) mode = argv[i][1], job = argv[++i];
+    else if (!strcmp(argv[i], "-w") && i + 1 < argc) shards = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-i") && i + 1 < argc) shard = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc) rotate = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+      limit = strtoull(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+      offset = strtoull(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "-g") && i + 1 < argc) gs = argv[++i];
+    else if (!strcmp(argv[i], "-S") && i + 1 < argc)
+      seed_secrandom(strtoull(argv[++i], NULL, 0));
+    else if (!strcmp(argv[i], "-p") && i + 1 < argc) ps = argv[++i];
+    else if (!strcmp(argv[i], "-q") && i + 1 < argc) qs = argv[++i];
+    else if (!strcmp(argv[i], "-x") && i + 1 < argc) xs = argv[++i];
+    else if (!strcmp(argv[i], "-K") && i + 1 < argc) ks = argv[++i];
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+      i++;
+      if (!strcmp(argv[i], "gcd") || !strcmp(argv[i], "residue"))
+        trial_gcd = argv[i][0] == 'g';
+      else eprintf("Unknown trial division engine `%s'.\n", argv[i]);
+    }
+    else if (!strcmp(argv[i], "-L") || !strcmp(argv[i], "-R"))
+      engine = argv[i][1];
+    else if (!strcmp(argv[i], "-N") && i + 1 < argc) bits = atoi(argv[++i]);
+    else eprintf("Usage: %s [-s [-r seconds] [-o offset] | -b | -k | -T]"
+                 " [-n bytes] [-S seed] [-N bits] [-p hex -q hex [-x hex]]"
+                 " [-K kernel] [-t engine] [-L | -R]\n"
+                 "       %s -M job -n bytes -w shards [options]\n"
+                 "       %s -W job -i shard | -V job | -J job\n"
+                 "       %s -C cache -g ranges | -o offset -n bytes [options]\n"
+                 "       %s -X cache [-o offset] [-n bytes]\n",
+                 argv[0], argv[0], argv[0], argv[0], argv[0]);
+  }
+  if (mode == 'W' || mode == 'V' || mode == 'J') {
+    if (ps) eprintf("The manifest fixes the parameters.\n");
+    read_manifest(job, &m);  bits = m.bits;
+  }
+  if (mode == 'X') {
+    if (ps) eprintf("The cache fixes the parameters.\n");
+    read_cache(job, &c);  bits = c.bits;
+  }
+  range_t one = { offset, limit, 0 }, * ranges = &one;  int nranges = 1;
+  if (mode == 'C' && gs && (offset || limit))
+    eprintf("-g excludes -o and -n.\n");
+  if (mode == 'C' && gs) nranges = parse_ranges(gs, &ranges);
+  else if (mode == 'C' && !limit)
+    eprintf("-C needs -g ranges or -n bytes.\n");
+  if (gs && mode != 'C') eprintf("-g only applies to -C.\n");
+  if (offset && mode != 's' && mode != 'C' && mode != 'X')
+    eprintf("-o only applies to -s, -C and -X.\n");
+  if (offset > UINT64_MAX / 8 || limit > UINT64_MAX / 8 - offset)
+    eprintf("The range exceeds 2^64 bits.\n");
+  if (mode == 'M' && (!limit || shards <= 0 || limit < (unsigned) shards))
+    eprintf("-M needs -n bytes and -w shards, at least a byte each.\n");
+  if (rotate && mode != 's') eprintf("-r only applies to -s.\n");
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    if (sizes[i]->bits == (bits ? bits : DEFAULT_BITS)) ops = sizes[i];
+  if (!ops) {
+    fprintf(stderr, "Unsupported modulus size. Choose one of:");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+      fprintf(stderr, " %d", sizes[i]->bits);
+    eprintf("\n");
+  }
+  if (!ps != !qs || (xs && !ps)) eprintf("-p and -q go together.\n");
+#if defined(TRACE) && defined(SIGPIPE)
+  signal(SIGPIPE, SIG_IGN); // Let a closed pipe end the stream via exit.
+#endif
+  if (!seeded) init_secrandom();
+  select_lanes();
+  if (mode == 'k' && !bits) {
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+      sizes[i]->init();  select_kernel(ks, sizes[i]->bits);
+      failed |= sizes[i]->kat();
+    }
+    return failed;
+  }
+  ops->init();  select_kernel(ks, ops->bits);
+  if (mode == 'k') return ops->kat();
+  if (mode == 'T') { ops->trial(limit ? limit : 1000);  return 0; }
+  fill = engine == 'L' ? ops->nextbytes_lanes
+       : engine == 'R' ? ops->nextbytes_rns : ops->nextbytes;
+  double t0 = seconds();
+  void * bbs = malloc(ops->size);
+  if (mode == 'X') ops->load(bbs, c.p, c.q, c.x);
+  else if (job && mode != 'M' && mode != 'C') ops->load(bbs, m.p, m.q, m.x);
+  else if (ps) ops->load(bbs, ps, qs, xs);
+  else ops->create(bbs);
+  if (mode == 'b')
+    printf("Generated a %d-bit modulus in %.3f s (%s kernel).\n",
+           ops->bits, seconds() - t0, kern->name);
+  if (mode == 's') {
+    if (offset) ops->set(bbs, offset * 8);
+    stream(bbs, limit, stdout);
+  }
+  else if (mode == 'b') bench(bbs, limit ? limit : 1 << 20);
+  else if (mode == 'M') write_manifest(job, bbs, limit, shards);
+  else if (mode == 'W') run_shard(bbs, &m, shard);
+  else if (mode == 'V' || mode == 'J') status = run_job(bbs, &m, mode == 'J');
+  else if (mode == 'C') write_cache(job, bbs, ranges, nranges);
+  else if (mode == 'X') serve_cache(bbs, &c, offset, limit, stdout);
+  else experiment(bbs);
+  ops->release(bbs);  free(bbs);
+  return status;
 }
 #endif
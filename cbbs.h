@@ -0,0 +1,80 @@
+// ---------------------------------------------------------------------------
+//      libcbbs: the Blum Blum Shub generator of bbs.c as a library. Build
+//      bbs.c with -DLIBRARY to leave out the CLI, e.g. with
+//      `cc -O3 -std=c23 -DLIBRARY -fPIC -shared -o libcbbs.so bbs.c',
+//      adding the threading backend of choice as for the CLI.
+//      Written and released to the public domain by Kamila Szewczyk.
+// ---------------------------------------------------------------------------
+#ifndef CBBS_H
+#define CBBS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ---------------------------------------------------------------------------
+//      A context is a modulus pq with everything derived from it. Making
+//      one runs the prime search, which dominates setup; afterwards it
+//      is read-only. A generator is a seed, a state and a position over a
+//      context, so any number of them can share one. The context must
+//      outlive its generators.
+//
+//      Thread safety: cbbs_init and cbbs_teardown must not overlap any
+//      other call. All other functions may be called from any thread.
+//      Contexts may be shared freely. A generator must not be used by two
+//      threads at once, but different generators are independent.
+//      cbbs_read splits large reads over the worker pool of the build
+//      (-DOPENMP or -DPTHREADS); with pthreads, reads from several
+//      threads take turns on the one pool. With -DLARGE moduli,
+//      cbbs_ctx_new, cbbs_ctx_load, cbbs_new and cbbs_seek use tens of
+//      KiB of the calling thread's stack.
+//
+//      Malformed parameters and exhausted memory end the process with a
+//      message on stderr, as in the CLI.
+// ---------------------------------------------------------------------------
+typedef struct cbbs_ctx cbbs_ctx_t;
+typedef struct cbbs_gen cbbs_t;
+
+// Opens the entropy source and picks the multi-precision kernel: NULL for
+// the fastest one for each modulus size, or "generic", "adx" or "ifma"
+// for all of them. Returns -1 if the kernel is not supported on this
+// machine, 0 otherwise.
+int cbbs_init(const char * kernel);
+// Frees the tables of every modulus size and closes the entropy source.
+// The worker pool and the reader thread, if started, stay idle.
+void cbbs_teardown(void);
+
+// A fresh modulus of `bits' bits (512 to 8192, up to 65536 with -DLARGE;
+// 0 for 8192), or NULL for a size that is not built in.
+cbbs_ctx_t * cbbs_ctx_new(int bits);
+// The modulus p * q from hexadecimal primes congruent to 3 mod 4.
+cbbs_ctx_t * cbbs_ctx_load(int bits, const char * p, const char * q);
+void cbbs_ctx_free(cbbs_ctx_t * ctx);
+int cbbs_ctx_bits(const cbbs_ctx_t * ctx);
+
+// A generator over ctx at position 0, with the hexadecimal seed x or,
+// if x is NULL, a fresh one.
+cbbs_t * cbbs_new(const cbbs_ctx_t * ctx, const char * x);
+void cbbs_free(cbbs_t * bbs);
+// Fills buf with the next len bytes of the keystream.
+void cbbs_read(cbbs_t * bbs, void * buf, size_t len);
+// The same on the reader thread, returning at once. Reads queue there in
+// the order they were asked for; each waits for the worker pool and then
+// calls done(arg), which must not wait on a later read. Until then, bbs
+// and buf must be left alone. Without -DOPENMP or -DPTHREADS, the read
+// and the call to done happen before cbbs_read_async returns.
+void cbbs_read_async(cbbs_t * bbs, void * buf, size_t len,
+                     void (*done)(void *), void * arg);
+// Positions count output bits, so byte i of the keystream is at 8 i.
+// A seek costs O(log pos) multiplications.
+void cbbs_seek(cbbs_t * bbs, uint64_t pos);
+uint64_t cbbs_tell(const cbbs_t * bbs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,280 @@
+// ---------------------------------------------------------------------------
+//      C++ interface to libcbbs (cbbs.h), header-only. cbbs::engine is a
+//      UniformRandomBitGenerator, so it plugs into <random> distributions
+//      and std::shuffle. Single draws come out of an internal buffer
+//      that is refilled with one cbbs_read, which splits large reads over
+//      the worker pool. Bulk requests (fill, generate_random) skip the
+//      buffer whenever they are larger than it. For event loops and
+//      pipelines, `co_await bytes(n)' reads on the worker pool while the
+//      coroutine is suspended, and blocks() streams the keystream in
+//      blocks, reading the next one while the last is used. Needs C++20.
+//      Written and released to the public domain by Kamila Szewczyk.
+// ---------------------------------------------------------------------------
+#ifndef CBBS_HPP
+#define CBBS_HPP
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cbbs.h"
+
+namespace cbbs {
+
+// Calls cbbs_init for its lifetime and cbbs_teardown at its end. Exactly
+// one should exist, outliving every context.
+class library {
+ public:
+  explicit library(const char * kernel = nullptr) {
+    if (cbbs_init(kernel))
+      throw std::invalid_argument("cbbs: unsupported kernel");
+  }
+  ~library() { cbbs_teardown(); }
+  library(const library &) = delete;
+  library & operator=(const library &) = delete;
+};
+
+// A modulus, shared read-only by the engines made from it, which it must
+// outlive. Move-only.
+class context {
+ public:
+  explicit context(int bits = 0) : ctx_(cbbs_ctx_new(bits)) { check(); }
+  context(int bits, const char * p, const char * q)
+      : ctx_(cbbs_ctx_load(bits, p, q)) { check(); }
+  int bits() const { return cbbs_ctx_bits(ctx_.get()); }
+  const cbbs_ctx_t * get() const { return ctx_.get(); }
+
+ private:
+  struct release { void operator()(cbbs_ctx_t * c) { cbbs_ctx_free(c); } };
+  std::unique_ptr<cbbs_ctx_t, release> ctx_;
+  void check() {
+    if (!ctx_) throw std::invalid_argument("cbbs: unsupported modulus size");
+  }
+};
+
+// A single-pass range of keystream blocks, made by engine::blocks. Each
+// block stays valid until the iterator is advanced.
+class block_stream {
+ public:
+  struct promise_type {
+    std::span<const unsigned char> block;
+    block_stream get_return_object() {
+      return block_stream(handle::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    std::suspend_always yield_value(std::span<const unsigned char> b) {
+      block = b;
+      return {};
+    }
+    void return_void() { }
+    void unhandled_exception() { throw; }
+  };
+  using handle = std::coroutine_handle<promise_type>;
+  class iterator {
+   public:
+    using value_type = std::span<const unsigned char>;
+    using difference_type = std::ptrdiff_t;
+    iterator() = default;
+    explicit iterator(handle h) : h_(h) { }
+    value_type operator*() const { return h_.promise().block; }
+    iterator & operator++() { h_.resume();  return *this; }
+    void operator++(int) { ++*this; }
+    bool operator==(std::default_sentinel_t) const { return h_.done(); }
+
+   private:
+    handle h_;
+  };
+
+  block_stream(block_stream && o) noexcept
+      : h_(std::exchange(o.h_, nullptr)) { }
+  block_stream & operator=(block_stream && o) noexcept {
+    std::swap(h_, o.h_);
+    return *this;
+  }
+  ~block_stream() { if (h_) h_.destroy(); }
+  iterator begin() { h_.resume();  return iterator(h_); }
+  std::default_sentinel_t end() const { return {}; }
+
+ private:
+  explicit block_stream(handle h) : h_(h) { }
+  handle h_;
+};
+
+// What bytes() does with the suspended coroutine by default.
+struct resume_inline {
+  void operator()(std::coroutine_handle<> h) const { h.resume(); }
+};
+
+// A generator over a context. Move-only: the state and the buffer are
+// heavy and a copy would repeat the keystream. Words are assembled from
+// the keystream in host byte order.
+class engine {
+ public:
+  using result_type = std::uint64_t;
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT64_MAX; }
+
+  // `buffer' bytes are read ahead for single draws. The seed is x, in
+  // hexadecimal, or a fresh one if x is null.
+  explicit engine(const context & ctx, const char * x = nullptr,
+                  std::size_t buffer = 1 << 16)
+      : bbs_(cbbs_new(ctx.get(), x)),
+        buf_(new unsigned char[buffer]), size_(buffer) { }
+  engine(engine &&) noexcept = default;
+  engine & operator=(engine &&) noexcept = default;
+
+  result_type operator()() {
+    result_type r;
+    if (size_ - at_ >= sizeof(r)) {
+      std::memcpy(&r, &buf_[at_], sizeof(r));
+      at_ += sizeof(r);
+    } else fill(&r, sizeof(r));
+    return r;
+  }
+  // The next len bytes of the keystream. Whatever the buffer holds goes
+  // first; a rest of at least a buffer is read straight into out.
+  void fill(void * out, std::size_t len) {
+    auto * p = static_cast<unsigned char *>(out);
+    while (len) {
+      if (at_ == size_) {
+        if (len >= size_) { cbbs_read(bbs_.get(), p, len);  return; }
+        cbbs_read(bbs_.get(), buf_.get(), size_);
+        at_ = 0;
+      }
+      std::size_t n = len < size_ - at_ ? len : size_ - at_;
+      std::memcpy(p, &buf_[at_], n);
+      at_ += n;  p += n;  len -= n;
+    }
+  }
+  // Starts reading the next len bytes into out, as cbbs_read_async does.
+  // done(arg) follows on the reading thread, or at once if the buffer
+  // held them all. The engine must be left alone until then.
+  void fill_async(void * out, std::size_t len, void (*done)(void *),
+                  void * arg) {
+    auto * p = static_cast<unsigned char *>(out);
+    std::size_t n = len < size_ - at_ ? len : size_ - at_;
+    if (n) std::memcpy(p, &buf_[at_], n);
+    at_ += n;
+    if (n == len) done(arg);
+    else cbbs_read_async(bbs_.get(), p + n, len - n, done, arg);
+  }
+  // Fills a contiguous range of unsigned integers with uniform values,
+  // as the generate_random customisation point of C++26 expects.
+  template <std::ranges::contiguous_range R>
+    requires std::ranges::sized_range<R>
+          && std::is_unsigned_v<std::ranges::range_value_t<R>>
+  void generate_random(R && r) {
+    fill(std::ranges::data(r),
+         std::ranges::size(r) * sizeof(std::ranges::range_value_t<R>));
+  }
+
+  // Positions count keystream bits consumed through this engine.
+  std::uint64_t tell() const {
+    return cbbs_tell(bbs_.get()) - 8 * (size_ - at_);
+  }
+  void seek(std::uint64_t pos) {
+    cbbs_seek(bbs_.get(), pos);
+    at_ = size_;
+  }
+  void discard(unsigned long long z) { seek(tell() + 64 * z); }
+
+  // `co_await bytes(n)' is the next n bytes. Unless the buffer holds
+  // them, the coroutine is suspended while they are read on the worker
+  // pool, and resumed on the thread that read them. If post is given,
+  // post(h) is called there instead of h.resume(), e.g. to hand the
+  // coroutine back to an event loop.
+  template <class Post> class bytes_op {
+   public:
+    bytes_op(engine & e, std::size_t n, Post post)
+        : e_(e), buf_(n), post_(std::move(post)) { }
+    bool await_ready() {
+      if (e_.size_ - e_.at_ < buf_.size()) return false;
+      e_.fill(buf_.data(), buf_.size());
+      return true;
+    }
+    // Once the read is started, *this may be gone at any moment.
+    void await_suspend(std::coroutine_handle<> h) {
+      h_ = h;
+      e_.fill_async(buf_.data(), buf_.size(), done, this);
+    }
+    std::vector<unsigned char> await_resume() { return std::move(buf_); }
+
+   private:
+    engine & e_;
+    std::vector<unsigned char> buf_;
+    Post post_;
+    std::coroutine_handle<> h_;
+    static void done(void * p) {
+      auto * op = static_cast<bytes_op *>(p);
+      std::coroutine_handle<> h = op->h_;
+      Post post = std::move(op->post_);
+      post(h);
+    }
+  };
+  template <class Post = resume_inline>
+  bytes_op<Post> bytes(std::size_t n, Post post = {}) {
+    return bytes_op<Post>(*this, n, std::move(post));
+  }
+
+  // The keystream as `count' blocks of `size' bytes (endless if count is
+  // 0). Two buffers alternate: while the consumer holds one block, the
+  // next is read on the worker pool. The engine must be left alone while
+  // the stream exists.
+  block_stream blocks(std::size_t size, std::uint64_t count = 0) {
+    std::vector<unsigned char> cur(size), next(size);
+    latch ready;  // Destroyed first, so that no read outlives the buffers.
+    ready.arm();
+    fill_async(cur.data(), size, latch::done, &ready);
+    for (std::uint64_t i = 0; !count || i < count; i++) {
+      ready.wait();
+      if (!count || i + 1 < count) {
+        ready.arm();
+        fill_async(next.data(), size, latch::done, &ready);
+      }
+      co_yield std::span<const unsigned char>(cur);
+      std::swap(cur, next);
+    }
+  }
+
+ private:
+  struct release { void operator()(cbbs_t * b) { cbbs_free(b); } };
+  std::unique_ptr<cbbs_t, release> bbs_;
+  std::unique_ptr<unsigned char[]> buf_;
+  std::size_t size_, at_ = size_;  // Bytes buffered, bytes used.
+  // Whether a read is in flight, for blocks().
+  // The reader signals under the lock, so that the latch cannot be
+  // destroyed between its store and its notification.
+  struct latch {
+    std::mutex m;
+    std::condition_variable cv;
+    bool busy = false;
+    ~latch() { wait(); }
+    void arm() { busy = true; }
+    void wait() {
+      std::unique_lock<std::mutex> lock(m);
+      cv.wait(lock, [this] { return !busy; });
+    }
+    static void done(void * p) {
+      auto * l = static_cast<latch *>(p);
+      std::lock_guard<std::mutex> lock(l->m);
+      l->busy = false;
+      l->cv.notify_all();
+    }
+  };
+};
+
+}
+
+#endif
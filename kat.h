@@ -0,0 +1,179 @@
+// ---------------------------------------------------------------------------
+//      Known-answer keystream vectors for the Blum Blum Shub generator.
+//      For each modulus size, the generator is loaded with a fixed p, q
+//      (the primes listed in README.md) and x0, seeked to `pos', and 32
+//      bytes are drawn. Checked by `bbs -k'.
+//      Regenerate only if the meaning of the output changes.
+// ---------------------------------------------------------------------------
+#define KAT_VECTORS 4
+typedef struct {
+  int bits;
+  const char * p, * q, * x0;
+  struct { unsigned pos; const char * out; } v[KAT_VECTORS];
+} bbs_kat;
+static const bbs_kat kats[] = {
+  { 512,
+    "9272b18be3bb488ca43d8a216df34b384f038bb72638345d0acaf6437696b8b7",
+    "deb6c5d9c2f23a8d9b8da3313c9ba614462f86223df2ceb5558dd9fbaf4f1747",
+    "4fc053c138842b7034edd22f34814060091e22e3fa252648373b4d9390831c8e"
+    "d81466c2fd3263e545afb3173ae7e945912bd4adb8652e0df970e1d67a447967",
+    {
+      { 0, "b43bdfc49307f6fce185fbb6694d54fe457fa8eaeaeee323aff5e7a62749628b" },
+      { 1, "6877bf89260fedf9c30bf76cd29aa9fc8aff51d5d5ddc6475febcf4c4e92c517" },
+      { 4099, "f9466e8dbeaf93923775376c12c4540c74d15416810475c2826b33fb4f763e43" },
+      { 1000003, "ef40ba404c799b3965d6c413ee6fdcfc6fa53aae87eda1e48349ae2500f418e8" },
+    }
+  },
+  { 1024,
+    "716eff6ad23845322b34d80092b7d15aa36401bf2a64a1e5e96d9f324e9775b2"
+    "f7f94f6a6b7c6ddeb2249dc339023d0ea6138d2cc84c14b09491f96ad0f074e7",
+    "d7c8ddcee7b01cba2b353bcc4a21c6cc8b3d00d63aa3ab47122ed83bb8be7fa4"
+    "2140f07d392c57aad8b73564d87b39849dd58d52d0f00eca735f6fc6afeadca7",
+    "510c9906646f8049e5620f60472c7f4ebd2e7700fec0c3fe90eb6e8a7e83f669"
+    "9e40edbedc0465169232c874ac4ad2e5c077621532374ade83a7bc999b7a8167"
+    "558263774708fefa35d80e6c9402b44600b0836937ec8b43475c5350ef3ef595"
+    "9ca5c69c6bf478fcd32a501aee6c6d10fb5244377d15460c55fbeef3ececff5",
+    {
+      { 0, "7b3ecab3edaf14491644e288518c13d8cc82ebdd1a8097ce48408c9ba091cd74" },
+      { 1, "f67d9567db5e28922c89c510a31827b19905d7ba35012f9c9081193741239ae9" },
+      { 4099, "8fe7ed143cac7754c41fd39ab8c593553c491db03d48acaf793e0d90bbc4e4db" },
+      { 1000003, "c390d90a1e29cd027c9e79f5a4794eadd6d51a8b2d23d06cca345ffc8e16f199" },
+    }
+  },
+  { 2048,
+    "5d33a7cf5ec6e2ebee512ce1c6799a5124bec8e7f9f7f2c72550c30b8cd3f776"
+    "b272bc9bf49509239b2c419b47294bd887e2871965aaac4021bf3c0ffbaf3907"
+    "88d05db1f5b25e822dbbbb2cea95469740eba17c109e50ae959f282b6ac3fdb7"
+    "5f8ea34e14e5ff032c0a13122b223a627933bf6b115543fee221a994445d4a6f",
+    "93f4fbdd207c34b7aef8cc063d1216f4847a575d5c3dd6791f37b01c8dbf88ca"
+    "3e38626c8dfe51e9001268189762c8f9914572ddcfe3c1625e2e1f411d2dc006"
+    "f54911590c4f0101956c332a28edc25247f1d2e86f282b7ce9766bf0b74a209d"
+    "34897781fb59eb2bba368e637fbb2ba8e7c6c1fe318f6b64df90aaf13eb2cac7",
+    "f0fda6f90159a8a69c58818f0e2e0b54556fd7256e73cb9f863542811d03f206"
+    "f719fb869c4a649fda415e2f5b6a3ffeba90c111f3fac74a2fad11530d792f51"
+    "11aa3b255fc51d411b270e7e7000b5d91a64f0c3529f602b4629d97b3d68087e"
+    "320b23ac80b42a46edbe3432af8c445894b2d873d168bd5ae80f2f9406aa1140"
+    "4c02e4c00f5b768872aa8291b4b7c3ea7bed40923a9ac6c652d25412bc1fec0f"
+    "63a34f87f67b2d12c5a0be920796eccec99709bd88ac41a040c8ac27b17ba0ae"
+    "7ba6042851652dd16f791a311e0a1d20feb8a379b3799e019f36598846f55ae4"
+    "1c7fcc547e6c950a627f0aa4b1a503db68f7ead8ab65aa9ef8e5f2bd755780",
+    {
+      { 0, "698fcdf9ffe9c2f899004b50d9272ba8b62ef26e4641e5b7f0a765c8effe6884" },
+      { 1, "d31f9bf3ffd385f1320096a1b24e57516c5de4dc8c83cb6fe14ecb91dffcd108" },
+      { 4099, "f974cb6534eba7859e05611472ce451ea7f341053f38be443b69235e99ad5c7c" },
+      { 1000003, "10245652e2b8b4856750af6ac629db04101e698800978f74764e1147e92df955" },
+    }
+  },
+  { 4096,
+    "901b6b1490fd8ded9d7b1e3cf8d9108304ac7360b60328b2e67ea33e09269bc5"
+    "73e2bcad7e68c1966fc714d6b5f49027b097d15f630ffb1ff4db0003b288b2dc"
+    "722ad541c30d99c6df6284972e7f20c7f16c56a0d2c9bd72c3abbd29c52ac718"
+    "c3a53c7444d71ec1037eb033545827dde81af108df87bcc1cabcd035193d2072"
+    "ca218e1182c197418ad897f84abaaabb1b5ee0503b237253ca6de5465eafa684"
+    "d02b33340b2f8c231ad0d04b3277fd0764df3a3ccf380f676cab0fbdad19e6aa"
+    "21876f4061321f2162a1178e7dbcc1f949cd75d21552d5c9e670a7e9c4fa9237"
+    "332dacefd38c0924560c476e3748e9ad9160bdb731493557aeb2d2c25dd1c667",
+    "31aae12f3dded1d49130023f3b6fc7fdcf81defde7f67d241a956465701c80cb"
+    "c87c3800cc70276bf3e538bf1490248f6e7c2ac42a57a1c8c02d748be203636d"
+    "5fdcdc5a8b2d36d039678d2341e8f4e5ffb78ccd00ab72dc9c419d8b1d485fa3"
+    "bfbb6f2e8b84b318ea8c30ae5a938fa0ab095810d1f96b02f5bd7cd918efdbdf"
+    "b0c9e12ee9f8c9c642b53aa6ba7124f1f596e743ea2c6ef480b948e333744cfc"
+    "bd06abd0ec6473b397374287458299c70be4ae0fc7f9046f2a9662ad019f41e0"
+    "112f1d0377c265891b3ed26ebbdd61d3c9ee7b315536058886a05a34da601ef2"
+    "ed603fdc3ea4059df0a5a1cf6e84c1d5779dfc9fee4fedd57e8a32fbb9d4cdf7",
+    "1525ab48aa1ad677b1d2a0a8db1966ff93e00df701390fd48cb8ace0e08cf1c5"
+    "324fabb933263d39af8708d54d3d809763d6bb907aee59ca28b57e600c098e56"
+    "d85b7bf750a45106a301191b909102604bfc2a58efaec4528d842297367151ab"
+    "ddbe071f7e1828d95275be45dfb6e744f8622e688be2edfa4fb9fe9b0deb6fab"
+    "a3e3419ba7289a9674e362cc95e1dfa1ab341b79f4dcc9a2369ebcb0fae87ebd"
+    "a5013d9d8c8800f89705b6239f9e2a55b4a17ca9eca90c9be4768f09854a1ae0"
+    "865b1e30d3b2943b0b5d3aed8beadde1ae9a0f616a7d41f3f8119ce44e546bb4"
+    "a590eb3b6a201360c467d631c796a17ea9d37b0a2fd4131a8293634cf31f8726"
+    "6cf189ab71d92afe7598970967d9b64ed3c7cc7d79fcfc6aea5b260c7de67c7c"
+    "5d1d212910b9c27d24bb17e3be87fa57f67c72cb0988c30597001931b52ac01a"
+    "52a38fb6b4e87c89c65ccf397810e4a175640e005251bfd2c6513597938cca63"
+    "af47119bba952dbffe209d5c408fd3eb4e58782c76278e59811183f0b80b2652"
+    "e68e9ea8bea8f0b0b5cca377107c4d638a44ef1f40c229ae482cecfa8d8d83ab"
+    "6616b99e73cc952932ae18f5e0df2ea01994b2862a0c3e60379bd4c077a4bda7"
+    "525b62a21e1e1ec6119a26fcaee8fd4fd0ee5c533e27f96444aed4e59c7483a7"
+    "9eeb4a0af6cdd61c2d9fa235739cd39aafcd15c6ca8a42375852d3b172b62a5",
+    {
+      { 0, "fdf1f53d9bd62cd59ed50139bdfe3023b33a145600b059fa40d5c183ca49873b" },
+      { 1, "fbe3ea7b37ac59ab3daa02737bfc6047667428ac0160b3f481ab830794930e76" },
+      { 4099, "3e5ca4a7dce0cb8d22a0ca29ed2fe3abbf4656aca526296ee3d96157db8834c6" },
+      { 1000003, "bfc322a5d7163a37cabff892f8db6c7c3223584600fd80d8a6940d06c3e71613" },
+    }
+  },
+  { 8192,
+    "29ed85d1e846071f5cdb3b019487401f082c4ac2316db2916fa1278a7c312555"
+    "b5206e89b52270fe8d54a4f526ce35d0e1716b250f3d76107b4c9ed8ef2dcc30"
+    "e927a039a960cca04656df06796554db16a6f9b6957b10355226e7f7ef840ea2"
+    "1c45429347a69acd1ad60037741ba0060735c676ed6b6cc453cd402ae5968760"
+    "980a06ded7765fa086788b2155f69b1d727d346c6f5c45b7231b59f43ee067b3"
+    "3329df7bf0b87123ee1759b3ea17c6391513e8c9ebd13078fa86c08dcf9fa597"
+    "4c5ca2c4228590b53f929a941b6371dc9b579b824d90fa37ed7e64e00c862e7a"
+    "bb3891d0decb8da754c1e84af3133bd4d3258ae2e96db19c797a7e8159760f61"
+    "61f66789962df94f95184dd17a7264d1a99db8556044a9640b9a19605d61a791"
+    "62bd809dc4613d5aa84ac1a20a9c85e5905749c0aeb9542af00bd6b3569fdaf8"
+    "2894f58462e5cc0b114721ea289e8bc0deca4b806a29e38a7308e634de0a8c75"
+    "10369de020d4bbaf4a01c4dde79b9f5db585b5689d7b905789ab05b7213cb4d1"
+    "76e04508094c9024da06a05f96f8471287808f729770a105781096db76ba2476"
+    "f6c5efc06a0a05d98a5a8410f6900e09fd100b23f561eb439b11e824b0a614f6"
+    "42d123525f6bf9cd19ac704b740a20948a3ebd3faf88432e822ffe2ca3bbcfbe"
+    "7846c335f6dd144296916d98f235bc7882008951fff70b7b32d629ca7344178f",
+    "643f44a1505bce191f5135f4ba3913fa597830b90f718683cb3b205f01cc1d02"
+    "a135483b8859f90750cb3caca37183894ec1115d3a1be44aabd017a6c734d8f8"
+    "af99fca0e4da780ffed8edc51c6fbe21600bafb263ad70356253405b0b3fc0c8"
+    "1550d33b7011a950c0aa5d42eb964de026c9d2dd230d28e7ac1c60cd51c3de7f"
+    "34181f686c0ab5d4d5af6cb831908eedc85e97d09bd83fbafa598e96aa378796"
+    "c559d51a4c2cbf86485c4abca09dda3ca1e0eddd373370ca1218e2dcbce6d709"
+    "7e517ba822b8559a8ce6a7896721c99ef6978480230c650332c0560a9dbe9d24"
+    "2b28fb0ae9074d9727c4754b4ecf93bd6c8f629c5149a75718810bf18225fda6"
+    "b2c4b5d3afe282c9fb1f9418d73b85d097674bdab297f0913147d679c89f4f1a"
+    "543fd0b4f30c396206d8b5cf37bbe29fc99d18796fd4c79109eb579a67171d45"
+    "38021363472f7cd3a68cb28f29779cb2d1d7fc393ecd60f18330ed638fa8f9ce"
+    "aa00360a4d7077b4eb90dc00347e7ea912c9f9f7945af57af79ed62214cc4b70"
+    "d2729b912444f4bcea8f62293191104298de8f4c3cd13a08e9a9341e70ca9cf2"
+    "98d0ef5f635fd604e88d00daa999ca1f1b0de1fbd130b8282d03b942d5d8f8c1"
+    "16494709fe213e8114afac4a3af3e47007c985460e9e406e7e01c90b72948006"
+    "f5cff0a136e7d10f954d54ebb059b112315b14ef723cf493f0cfbee0f602c66f",
+    "f0c9e64a146f0858e299a272651483d296918f9e47d90233beb2b52ffb6dca40"
+    "815e4b0b41efe844f7ef72181fec130c5a933b65eed4bcd6a81e7c5c88724e3d"
+    "1a120a1c035e5eb2ca6c7665b3b135a6303dee8bbd927157a171579acf47b177"
+    "ca98bba467b388de1194d458ad81db8dd2e397b125f7bbff5eb07a7477af268b"
+    "d9143cb988723b1ded22482e3f476149c84bc2b71a65fb6d8e8545f3fbcd80e4"
+    "7cbd040b668e646e245371143b4f2bc3045ffbb39c613626cd57b560baba1b6b"
+    "b0708dd1ddc6ac541c0524bcd6759e0fd28c049616d48445c9b521e5f17ffb17"
+    "d7a929cbb5df97c2776083d17215f4d0c15acb83f460b2c24fafe75ad81c081e"
+    "de23b21c8fc991d5da0040f156e3a282f27d26f6e407fa4199bf4291a6303a46"
+    "73f3029203ad950d89762f8867da9027588ca6b2369516dfceb9aa543fd0fcba"
+    "8299124fb46467d587d03c73fd6439800fb48197b7ad1271c364adb13520dde9"
+    "c56c237d65201b044d957c95b9eb5f95511009839df8b1b526b1e0e78249edd3"
+    "2310d25d1e5ae8c83f7654bf1725b76bdc8315239adb8f615b8cd4fb614b0ad8"
+    "d73f39eca9f673b2f81077e4455b7fb6af38b372b70fe000dcbdf489c6245ae2"
+    "1fbe8635f828095fdbdc908e6b8562de37598e85bd9a30a43c7c140b19a70bae"
+    "babc2e400c323d8ed756ad0de0811ef6e25f87b3c9c4b3223da94a40bc77880a"
+    "7d442671fde9bde84f97c999b0b5c963f3db85c5d14957a1d9e63fffd93f50a3"
+    "7237ec6b7aaae16369fce5c7687a09935d788c73a29ae5dc7e9b1496440094ee"
+    "042d23ad4eb63316f8caa5fe0ec3fce0e534a3e4d7c9c89deae8051f7b9686c9"
+    "29c9310e38b0e10e96275cfcf61099a658ef52d8119876b9a5078a1cf78f1971"
+    "6711ddcedd6e78e42c5a38c58820ba4d6b3f3fb402eb1ea24eb98a944772309b"
+    "34132d8ea179358af1f0d091bce882f6ecc973f1aa8cf02776ab9165da332fc5"
+    "384e444f593e45fd413cb9dbb99aa4d14c3c6c8cd0e4f061a0c2e3902ca1d988"
+    "764b288bac8b23e69b8253cb3f5db60d4050af53ff5d616d40519ad79bbc2e80"
+    "c2acbfcb24e4c0d702d61b564ca200817e86a55e4fa6170beaf957ed9351e1ef"
+    "4bffe4ace708cdbcdaac653d5c7e3a1f1da24c1caf8b0ac43988fef339adedb3"
+    "18bb79b1d61990b6ecdcb75a23223e0f88e9acbb6eadd052e92ed4579666fdea"
+    "aa67980078a2dcfb5e5993596a3c0a26a4b54a98b50cd48912d874802275b859"
+    "952b37c504e37ff871726907e6c425ed81e1a1f2bbc4b8fce9606dfa18987f49"
+    "f18170fce7717ed4902443b5c4e8317a6308320cb24d6c8be55416fbe180c7c8"
+    "f319bdef226eb7dae86891352f5a26cf09e289a1c46cd3d4c2aab5cbed3af867"
+    "a359a0758b69ee3d232746934cdd56fb04cda89e5566cbff80d68b154ecc813",
+    {
+      { 0, "c42f098e36eed4b83bd2e4bc01ed0afc3ed1fe3434399ef3d9313380b4dcbb64" },
+      { 1, "885e131c6ddda97077a5c97803da15f87da3fc6868733de7b262670169b976c8" },
+      { 4099, "27dae0e19f0a8830cb0112dce038ffb0e5d975dbefa2ae810cfb6ea87a357a3c" },
+      { 1000003, "19b54005d21ac0888474c07916e1d9adc22bb64fdd1322f2c763b900145a59e9" },
+    }
+  }
+};